@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "features.hpp"
+#include "hue_histogram.hpp"
+#include "matching.hpp"
+#include "object_analysis.hpp"
+#include "options.hpp"
+#include "scratch.hpp"
+#include "shape_detector.hpp"
+#include "surf_detector.hpp"
+#include "synthetic_images.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+using namespace cv;
+
+// Times each hot stage of set1, set2 and set3 in isolation over the same
+// generated images. Every stage runs over all images --repeat times and
+// the fastest run is reported, with a checksum of the stage's results so
+// that two builds can be checked for doing the same work.
+
+typedef chrono::steady_clock Clock;
+
+const int JPEG_QUALITY = 90;
+
+// inputs of every stage, prepared once before timing starts
+struct BenchInputs {
+        vector<Mat> encoded;
+        vector<Mat> color;
+        vector<Mat> gray;
+        vector<Mat> hsv;
+        vector<Mat> contours;
+        vector<Mat> descriptors;
+        vector<Mat> hueHists;
+};
+
+struct Stage {
+        const char *name;
+        // result of one image, summed into the checksum
+        function<double(const BenchInputs &, size_t)> run;
+};
+
+static Mat hueHistogram(const Mat &hsv) {
+        Mat hsvPlanes[3];
+        split(hsv, hsvPlanes);
+        Mat hueHist;
+        int hueHistSize = HUE_HIST_BINS;
+        float range [] = {0, 180};
+        const float *hueHistRange = range;
+        calcHist(&hsvPlanes[0], 1, 0, Mat(), hueHist, 1, &hueHistSize, &hueHistRange, 1, 0);
+        normalize(hueHist, hueHist, 0, 1, NORM_MINMAX, -1, Mat());
+        return hueHist;
+}
+
+// feature backend of the features and knn-match stages
+static FeatureExtractor features;
+
+static void computeFeatures(const Mat &gray, Mat &descriptors) {
+        vector<KeyPoint> keypoints;
+        features.compute(gray, keypoints, descriptors);
+}
+
+static BenchInputs prepareInputs(const vector<SyntheticImage> &images) {
+        BenchInputs inputs;
+        for (auto &synthetic : images) {
+                vector<uchar> encoded;
+                imencode(".jpg", synthetic.image, encoded, vector<int>{CV_IMWRITE_JPEG_QUALITY, JPEG_QUALITY});
+                inputs.encoded.push_back(Mat(encoded, true));
+
+                // stages downstream of decode see what set1, set2 and set3 see
+                Mat color = imdecode(inputs.encoded.back(), CV_LOAD_IMAGE_COLOR);
+                Mat gray, hsv, blurred, contours, descriptors;
+                cvtColor(color, gray, CV_BGR2GRAY);
+                cvtColor(color, hsv, CV_BGR2HSV);
+                prepareImageMats(gray, blurred, contours);
+                computeFeatures(gray, descriptors);
+
+                inputs.color.push_back(color);
+                inputs.gray.push_back(gray);
+                inputs.hsv.push_back(hsv);
+                inputs.contours.push_back(contours);
+                inputs.descriptors.push_back(descriptors);
+                inputs.hueHists.push_back(hueHistogram(hsv));
+        }
+        return inputs;
+}
+
+static vector<Stage> benchStages() {
+        vector<Stage> stages;
+
+        stages.push_back({"decode", [](const BenchInputs &in, size_t i) {
+                return (double)imdecode(in.encoded[i], CV_LOAD_IMAGE_COLOR).rows;
+        }});
+        stages.push_back({"decode-gray", [](const BenchInputs &in, size_t i) {
+                return (double)imdecode(in.encoded[i], CV_LOAD_IMAGE_GRAYSCALE).rows;
+        }});
+
+        // set1
+        stages.push_back({"polygon-sides", [](const BenchInputs &in, size_t i) {
+                return (double)countPolygonSides(in.gray[i]);
+        }});
+
+        // set2
+        stages.push_back({"features", [](const BenchInputs &in, size_t i) {
+                Mat descriptors;
+                computeFeatures(in.gray[i], descriptors);
+                return (double)descriptors.rows;
+        }});
+        stages.push_back({"knn-match", [](const BenchInputs &in, size_t i) {
+                const Mat &train = in.descriptors[(i + 1) % in.descriptors.size()];
+                if (in.descriptors[i].rows < 2 || train.rows < 2) {
+                        return 0.0;
+                }
+                return (double)countGoodMatches(in.descriptors[i], train, DIST_COEFF);
+        }});
+        stages.push_back({"red-pixels", [](const BenchInputs &in, size_t i) {
+                return (double)countRedPixels(in.color[i]);
+        }});
+
+        // set3
+        stages.push_back({"prepare-mats", [](const BenchInputs &in, size_t i) {
+                Mat grayImage, contourImage;
+                prepareImageMats(in.gray[i], grayImage, contourImage);
+                return (double)countNonZero(contourImage);
+        }});
+        stages.push_back({"clean-contours", [](const BenchInputs &in, size_t i) {
+                vector<Point> contourPoints;
+                findNonZero(in.contours[i], contourPoints);
+                if (contourPoints.empty()) {
+                        return 0.0;
+                }
+                cleanContoursWithSigma(contourPoints, 2.0);
+                return (double)contourPoints.size();
+        }});
+        stages.push_back({"hue-hist", [](const BenchInputs &in, size_t i) {
+                return (double)hueHistogram(in.hsv[i]).at<float>(0);
+        }});
+        stages.push_back({"hue-hist-bgr", [](const BenchInputs &in, size_t i) {
+                // the same histogram straight from BGR, so the same checksum
+                Mat hueHist;
+                bgrHueHistogram<HUE_HIST_BINS, 0, 180>(in.color[i], hueHist);
+                normalize(hueHist, hueHist, 0, 1, NORM_MINMAX, -1, Mat());
+                return (double)hueHist.at<float>(0);
+        }});
+        stages.push_back({"compare-hist", [](const BenchInputs &in, size_t i) {
+                // one test histogram against every other, like compareHueHistograms did
+                double total = 0;
+                for (auto &training : in.hueHists) {
+                        total += compareHist(in.hueHists[i], training, CV_COMP_CORREL);
+                }
+                return total;
+        }});
+
+        return stages;
+}
+
+// runs set1's and set3's per-image analysis twice over the images on this
+// thread; the first pass grows the scratch to the largest image, so the
+// second must not reallocate any of its buffers. Small dark squares in the
+// corners of some images vary the number of contours from one image to
+// the next, up and down.
+static bool checkScratch(const BenchInputs &inputs) {
+        const int extraContours[] = {0, 3, 1, 2};
+        vector<Mat> color, gray, reduced;
+        for (size_t i = 0; i < inputs.color.size(); i++) {
+                Mat image = inputs.color[i].clone();
+                Point corners[] = {Point(2, 2), Point(image.cols - 12, 2), Point(2, image.rows - 12)};
+                for (int c = 0; c < extraContours[i % 4]; c++) {
+                        rectangle(image, Rect(corners[c].x, corners[c].y, 10, 10), Scalar::all(0), CV_FILLED);
+                }
+                Mat imageGray, imageReduced;
+                cvtColor(image, imageGray, CV_BGR2GRAY);
+                resize(imageGray, imageReduced, Size(), 0.5, 0.5, INTER_AREA);
+                color.push_back(image);
+                gray.push_back(imageGray);
+                reduced.push_back(imageReduced);
+        }
+
+        Scratch &scratch = Scratch::local();
+        size_t warmedUp = 0;
+        for (int pass = 0; pass < 2; pass++) {
+                warmedUp = scratch.allocations();
+                for (size_t i = 0; i < color.size(); i++) {
+                        countPolygonSides(gray[i]);
+                        countPolygonSidesReduced(reduced[i], 2);
+                        Frame frame;
+                        frame.assign(color[i]);
+                        ObjectData data;
+                        analyzeImage(frame, data, false);
+                }
+        }
+        size_t steady = scratch.allocations() - warmedUp;
+        cout << "scratch allocations: " << warmedUp << " warming up, " << steady << " after" << endl;
+        return steady == 0;
+}
+
+static bool parseShapes(const string &list, vector<int> &shapes) {
+        istringstream stream(list);
+        string name;
+        while (getline(stream, name, ',')) {
+                int shape = syntheticShapeByName(name);
+                if (shape < 0) {
+                        return false;
+                }
+                shapes.push_back(shape);
+        }
+        return !shapes.empty();
+}
+
+int main(int argc, char **argv) {
+        Options options(argc, argv);
+
+        Size size(options.getInt("width", 640), options.getInt("height", 480));
+        int count = options.getInt("count", 64);
+        int repeat = max(1, options.getInt("repeat", 5));
+        unsigned seed = options.getInt("seed", 1);
+        string only = options.get("stage");
+
+        vector<int> shapes;
+        if (!parseShapes(options.get("shapes", "triangle,quad,round,red"), shapes) ||
+            !features.create(options.get("features", defaultFeatureBackend())) ||
+            size.width <= 0 || size.height <= 0 || count <= 0) {
+                cerr << "Usage: ndbench [--width=<px>] [--height=<px>] [--count=<n>] [--seed=<n>]"
+                     << " [--shapes=triangle,quad,round,red] [--features=surf|orb|brisk]"
+                     << " [--repeat=<n>] [--threads=<n>] [--stage=<name>] [--write=<dir>]"
+                     << " [--check-scratch]" << endl;
+                exit(-1);
+        }
+
+        auto images = generateSyntheticImages(shapes, count, size, seed);
+
+        // only write the data set, for running set1, set2 and set3 on it
+        string writeDir = options.get("write");
+        if (!writeDir.empty()) {
+                if (!writeSyntheticImages(images, writeDir)) {
+                        cerr << "Cannot write images to " << writeDir << endl;
+                        exit(-1);
+                }
+                exit(0);
+        }
+
+        BenchInputs inputs = prepareInputs(images);
+
+        // only check that the scratch buffers reach a steady state
+        if (options.has("check-scratch")) {
+                exit(checkScratch(inputs) ? 0 : -1);
+        }
+
+        // serial unless --threads is given, to see how each stage scales
+        unique_ptr<ThreadPool> pool;
+        if (options.has("threads")) {
+                pool.reset(new ThreadPool(options.getInt("threads", 0)));
+        }
+
+        cout << "images: " << count << " of " << size.width << "x" << size.height
+             << "\tthreads: " << (pool ? pool->size() : 1) << "\tfeatures: " << features.backend() << endl;
+        cout << left << setw(16) << "stage" << right << setw(12) << "ms" << setw(14) << "us/image"
+             << setw(14) << "images/s" << setw(18) << "checksum" << endl;
+
+        vector<double> results(count);
+        for (auto &stage : benchStages()) {
+                if (!only.empty() && only != stage.name) {
+                        continue;
+                }
+
+                double best = 0;
+                for (int r = 0; r < repeat; r++) {
+                        auto start = Clock::now();
+                        if (pool) {
+                                pool->parallelFor(count, [&](size_t i) {
+                                        results[i] = stage.run(inputs, i);
+                                });
+                        } else {
+                                for (int i = 0; i < count; i++) {
+                                        results[i] = stage.run(inputs, i);
+                                }
+                        }
+                        double elapsed = chrono::duration<double, milli>(Clock::now() - start).count();
+                        best = r == 0 ? elapsed : min(best, elapsed);
+                }
+
+                double checksum = 0;
+                for (auto result : results) {
+                        checksum += result;
+                }
+                cout << left << setw(16) << stage.name << right << fixed << setprecision(2)
+                     << setw(12) << best << setw(14) << best * 1000 / count
+                     << setw(14) << count / (best / 1000) << setw(18) << checksum << endl;
+        }
+
+        return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// Blocking multi producer / multi consumer queue with a fixed capacity,
+// used to connect pipeline stages so a fast stage cannot run ahead of a
+// slow one and pile up decoded images in memory.
+template <typename T>
+class BoundedQueue {
+public:
+        explicit BoundedQueue(size_t capacity) : capacity(capacity) {}
+
+        // blocks while full, returns false if the queue was closed
+        bool push(T item) {
+                std::unique_lock<std::mutex> lock(mutex);
+                notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+                if (closed) {
+                        return false;
+                }
+                items.push_back(std::move(item));
+                notEmpty.notify_one();
+                return true;
+        }
+
+        // never blocks; when full, the oldest item is dropped to make room
+        // and evicted is set. Returns false if the queue was closed.
+        bool pushEvictingOldest(T item, bool &evicted) {
+                std::lock_guard<std::mutex> lock(mutex);
+                evicted = false;
+                if (closed) {
+                        return false;
+                }
+                if (items.size() >= capacity) {
+                        items.pop_front();
+                        evicted = true;
+                }
+                items.push_back(std::move(item));
+                notEmpty.notify_one();
+                return true;
+        }
+
+        // blocks while empty, returns false once closed and drained
+        bool pop(T &item) {
+                std::unique_lock<std::mutex> lock(mutex);
+                notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+                if (items.empty()) {
+                        return false;
+                }
+                item = std::move(items.front());
+                items.pop_front();
+                notFull.notify_one();
+                return true;
+        }
+
+        // never blocks, returns false when nothing is queued right now
+        bool tryPop(T &item) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (items.empty()) {
+                        return false;
+                }
+                item = std::move(items.front());
+                items.pop_front();
+                notFull.notify_one();
+                return true;
+        }
+
+        // wakes every waiter, items already queued can still be popped
+        void close() {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+                notEmpty.notify_all();
+                notFull.notify_all();
+        }
+
+private:
+        size_t capacity;
+        bool closed = false;
+        std::deque<T> items;
+        std::mutex mutex;
+        std::condition_variable notEmpty;
+        std::condition_variable notFull;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef CASCADE_HPP
+#define CASCADE_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "metrics.hpp"
+
+// items run before the gates are first reordered, and between reorders
+const uint64_t CASCADE_REORDER_INTERVAL = 32;
+
+// Independent pass/fail gates an item must all pass to be accepted. As
+// the verdict is their conjunction, the gates can run in any order and
+// the first failing one settles it, so the remaining ones are skipped.
+// Each gate's mean cost and rejection rate are measured on the items it
+// sees, and every CASCADE_REORDER_INTERVAL items the gates are sorted by
+// expected cost per rejection, so a cheap gate rejecting most items runs
+// first. Gates are added in a sensible initial order. run() may be called
+// from several threads at once.
+template <typename Item>
+class GateCascade {
+public:
+        typedef std::function<bool(Item &)> Gate;
+
+        static const size_t MAX_GATES = 16;
+
+        // at most MAX_GATES gates, more fail the assertion; name must
+        // outlive the cascade, a string literal in practice
+        void add(const char *name, Gate gate) {
+                CV_Assert(stages.size() < MAX_GATES);
+                std::unique_ptr<Stage> stage(new Stage);
+                stage->name = name;
+                stage->gate = gate;
+                stages.push_back(std::move(stage));
+                order.store(identityOrder(), std::memory_order_relaxed);
+        }
+
+        // true when every gate passes
+        bool run(Item &item) {
+                uint64_t current = order.load(std::memory_order_relaxed);
+                bool accepted = true;
+                for (size_t i = 0; i < stages.size(); i++) {
+                        Stage &stage = *stages[(current >> (i * ORDER_BITS)) & ORDER_MASK];
+                        auto start = std::chrono::steady_clock::now();
+                        bool passed = stage.gate(item);
+                        auto elapsed = std::chrono::steady_clock::now() - start;
+
+                        stage.runs.fetch_add(1, std::memory_order_relaxed);
+                        stage.nanoseconds.fetch_add(
+                                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                                std::memory_order_relaxed);
+                        if (!passed) {
+                                stage.rejections.fetch_add(1, std::memory_order_relaxed);
+                                ND_COUNT("cascade_skipped_gates", stages.size() - i - 1);
+                                accepted = false;
+                                break;
+                        }
+                }
+
+                if (++items % CASCADE_REORDER_INTERVAL == 0) {
+                        reorder();
+                }
+                return accepted;
+        }
+
+private:
+        // gate indices packed into one word, so run() reads the order
+        // without a lock
+        static const int ORDER_BITS = 4;
+        static const uint64_t ORDER_MASK = (1 << ORDER_BITS) - 1;
+        static_assert(MAX_GATES * ORDER_BITS <= 64, "the order must fit one word");
+
+        struct Stage {
+                const char *name;
+                Gate gate;
+                std::atomic<uint64_t> runs{0};
+                std::atomic<uint64_t> rejections{0};
+                std::atomic<uint64_t> nanoseconds{0};
+        };
+
+        uint64_t identityOrder() const {
+                uint64_t packed = 0;
+                for (size_t i = 0; i < stages.size(); i++) {
+                        packed |= (uint64_t)i << (i * ORDER_BITS);
+                }
+                return packed;
+        }
+
+        void reorder() {
+                std::unique_lock<std::mutex> lock(reorderMutex, std::try_to_lock);
+                if (!lock.owns_lock()) {
+                        return;
+                }
+
+                // a gate not run yet keeps a zero cost and stays in front
+                // until it has been measured
+                std::vector<std::pair<double, size_t> > costs;
+                for (size_t i = 0; i < stages.size(); i++) {
+                        double runs = stages[i]->runs.load(std::memory_order_relaxed);
+                        double rejections = stages[i]->rejections.load(std::memory_order_relaxed);
+                        double cost = runs ? stages[i]->nanoseconds.load(std::memory_order_relaxed) / runs : 0;
+                        // smoothed, a gate that never rejected still ranks by cost
+                        double rejectionRate = (rejections + 1) / (runs + 2);
+                        costs.push_back(std::make_pair(cost / rejectionRate, i));
+                }
+                std::stable_sort(costs.begin(), costs.end());
+
+                uint64_t packed = 0;
+                for (size_t i = 0; i < costs.size(); i++) {
+                        packed |= (uint64_t)costs[i].second << (i * ORDER_BITS);
+                }
+                order.store(packed, std::memory_order_relaxed);
+        }
+
+        std::vector<std::unique_ptr<Stage> > stages;
+        std::atomic<uint64_t> order{0};
+        std::atomic<uint64_t> items{0};
+        std::mutex reorderMutex;
+};
+
+#endif
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "descriptor_codec.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+using namespace cv;
+
+static const char *QUANTIZATION_NAMES[] = {"none", "int8", "fp16"};
+
+// largest int8 magnitude a training value is scaled to
+const float INT8_RANGE = 127;
+
+int quantizationByName(const string &name) {
+        for (int i = 0; i <= QUANTIZE_FP16; i++) {
+                if (name == QUANTIZATION_NAMES[i]) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+// IEEE half from float, round to nearest even
+static uint16_t floatToHalf(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        if (exponent >= 31) {
+                // overflow and infinities saturate, descriptors have no NaNs
+                return sign | 0x7bff;
+        }
+        if (exponent <= 0) {
+                if (exponent < -10) {
+                        return sign;
+                }
+                // subnormal half
+                mantissa |= 0x800000;
+                int shift = 14 - exponent;
+                uint32_t half = mantissa >> shift;
+                uint32_t rest = mantissa & ((1u << shift) - 1);
+                uint32_t halfway = 1u << (shift - 1);
+                if (rest > halfway || (rest == halfway && (half & 1))) {
+                        half++;
+                }
+                return sign | half;
+        }
+
+        uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+        uint32_t rest = mantissa & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+                // may carry into the exponent, which is still correct
+                half++;
+        }
+        return half;
+}
+
+static float halfToFloat(uint16_t half) {
+        uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+        int exponent = (half >> 10) & 0x1f;
+        uint32_t mantissa = half & 0x3ff;
+        uint32_t bits;
+
+        if (exponent == 0) {
+                float value = ldexp((float)mantissa, -24);
+                return sign ? -value : value;
+        }
+        if (exponent == 31) {
+                bits = sign | 0x7f800000 | (mantissa << 13);
+        } else {
+                bits = sign | ((uint32_t)(exponent - 15 + 127) << 23) | (mantissa << 13);
+        }
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+}
+
+// every half converted once, the distance loops only look them up
+static const float *halfTable() {
+        static vector<float> table = [] {
+                vector<float> values(1 << 16);
+                for (size_t i = 0; i < values.size(); i++) {
+                        values[i] = halfToFloat((uint16_t)i);
+                }
+                return values;
+        }();
+        return table.data();
+}
+
+struct Int8Distance {
+        typedef int Value;
+        int operator()(const schar *a, const schar *b, int cols) const {
+                int sum = 0;
+                for (int i = 0; i < cols; i++) {
+                        int diff = a[i] - b[i];
+                        sum += diff * diff;
+                }
+                return sum;
+        }
+};
+
+struct HalfDistance {
+        typedef float Value;
+        const float *table = halfTable();
+        float operator()(const ushort *a, const ushort *b, int cols) const {
+                float sum = 0;
+                for (int i = 0; i < cols; i++) {
+                        float diff = table[a[i]] - table[b[i]];
+                        sum += diff * diff;
+                }
+                return sum;
+        }
+};
+
+struct FloatDistance {
+        typedef float Value;
+        float operator()(const float *a, const float *b, int cols) const {
+                float sum = 0;
+                for (int i = 0; i < cols; i++) {
+                        float diff = a[i] - b[i];
+                        sum += diff * diff;
+                }
+                return sum;
+        }
+};
+
+template<typename T, typename Distance>
+static int countGoodMatchesBruteForce(const Mat &query, const Mat &train, double distCoeff, Distance distance) {
+        int goodMatches = 0;
+        if (query.empty() || train.rows < 2) {
+                return goodMatches;
+        }
+        CV_Assert(query.cols == train.cols);
+
+        // the distances are squared, the ratio is on true L2 distances as
+        // in the FLANN matcher
+        typedef typename Distance::Value Value;
+        double ratio = distCoeff * distCoeff;
+        for (int i = 0; i < query.rows; i++) {
+                const T *queryRow = query.ptr<T>(i);
+                Value best = numeric_limits<Value>::max(), second = numeric_limits<Value>::max();
+                for (int j = 0; j < train.rows; j++) {
+                        Value d = distance(queryRow, train.ptr<T>(j), query.cols);
+                        if (d < best) {
+                                second = best;
+                                best = d;
+                        } else if (d < second) {
+                                second = d;
+                        }
+                }
+                if (best <= ratio * second) {
+                        goodMatches++;
+                }
+        }
+        ND_COUNT("good_matches", goodMatches);
+        return goodMatches;
+}
+
+int countGoodMatchesExact(const Mat &query, const Mat &train, double distCoeff) {
+        return countGoodMatchesBruteForce<float>(query, train, distCoeff, FloatDistance());
+}
+
+void DescriptorCodec::fit(const Mat &descriptors, int dims, int quantization) {
+        CV_Assert(descriptors.type() == CV_32F);
+        quantize = quantization;
+        scale = 1;
+
+        Mat projected;
+        if (dims > 0 && dims < descriptors.cols) {
+                PCA pca(descriptors, Mat(), PCA::DATA_AS_ROW, dims);
+                mean = pca.mean.clone();
+                eigenvectors = pca.eigenvectors.clone();
+                projected = pca.project(descriptors);
+        } else {
+                mean = Mat::zeros(1, descriptors.cols, CV_32F);
+                eigenvectors = Mat();
+                projected = descriptors;
+        }
+
+        if (quantize == QUANTIZE_INT8) {
+                double minValue, maxValue;
+                minMaxLoc(projected, &minValue, &maxValue);
+                double largest = max(fabs(minValue), fabs(maxValue));
+                scale = largest > 0 ? INT8_RANGE / largest : 1;
+        }
+}
+
+void DescriptorCodec::encode(const Mat &descriptors, Mat &encoded) const {
+        if (descriptors.empty()) {
+                encoded = Mat();
+                return;
+        }
+
+        Mat projected;
+        if (eigenvectors.empty()) {
+                projected = descriptors;
+        } else {
+                // same as PCA::project
+                Mat centered = descriptors - repeat(mean, descriptors.rows, 1);
+                gemm(centered, eigenvectors, 1, Mat(), 0, projected, GEMM_2_T);
+        }
+
+        switch (quantize) {
+        case QUANTIZE_INT8:
+                projected.convertTo(encoded, CV_8S, scale);
+                break;
+        case QUANTIZE_FP16:
+                encoded.create(projected.rows, projected.cols, CV_16U);
+                for (int i = 0; i < projected.rows; i++) {
+                        const float *source = projected.ptr<float>(i);
+                        ushort *target = encoded.ptr<ushort>(i);
+                        for (int j = 0; j < projected.cols; j++) {
+                                target[j] = floatToHalf(source[j]);
+                        }
+                }
+                break;
+        default:
+                encoded = projected.clone();
+        }
+}
+
+void DescriptorCodec::decode(const Mat &encoded, Mat &descriptors) const {
+        switch (quantize) {
+        case QUANTIZE_INT8:
+                encoded.convertTo(descriptors, CV_32F, 1 / scale);
+                break;
+        case QUANTIZE_FP16: {
+                const float *table = halfTable();
+                descriptors.create(encoded.rows, encoded.cols, CV_32F);
+                for (int i = 0; i < encoded.rows; i++) {
+                        const ushort *source = encoded.ptr<ushort>(i);
+                        float *target = descriptors.ptr<float>(i);
+                        for (int j = 0; j < encoded.cols; j++) {
+                                target[j] = table[source[j]];
+                        }
+                }
+                break;
+        }
+        default:
+                descriptors = encoded;
+        }
+}
+
+int DescriptorCodec::countGoodMatches(const Mat &query, const Mat &train, double distCoeff) const {
+        switch (quantize) {
+        case QUANTIZE_INT8:
+                return countGoodMatchesBruteForce<schar>(query, train, distCoeff, Int8Distance());
+        case QUANTIZE_FP16:
+                return countGoodMatchesBruteForce<ushort>(query, train, distCoeff, HalfDistance());
+        default:
+                return countGoodMatchesBruteForce<float>(query, train, distCoeff, FloatDistance());
+        }
+}
+
+// section layout: quantization, input cols, dims (0 without PCA) as
+// int32, scale as float, then the mean and eigenvector rows as floats
+std::vector<char> DescriptorCodec::serialize() const {
+        int32_t fields[3] = {quantize, mean.cols, eigenvectors.rows};
+        vector<char> bytes((const char *)fields, (const char *)(fields + 3));
+        bytes.insert(bytes.end(), (const char *)&scale, (const char *)(&scale + 1));
+        bytes.insert(bytes.end(), mean.ptr<char>(), mean.ptr<char>() + mean.cols * sizeof(float));
+        for (int i = 0; i < eigenvectors.rows; i++) {
+                bytes.insert(bytes.end(), eigenvectors.ptr<char>(i), eigenvectors.ptr<char>(i) + eigenvectors.cols * sizeof(float));
+        }
+        return bytes;
+}
+
+bool DescriptorCodec::deserialize(const char *data, size_t length) {
+        int32_t fields[3];
+        if (length < sizeof(fields) + sizeof(float)) {
+                return false;
+        }
+        memcpy(fields, data, sizeof(fields));
+        int cols = fields[1], rows = fields[2];
+        size_t expected = sizeof(fields) + sizeof(float) + (size_t)(1 + rows) * cols * sizeof(float);
+        if (fields[0] < QUANTIZE_NONE || fields[0] > QUANTIZE_FP16 || cols <= 0 || rows < 0 || length != expected) {
+                return false;
+        }
+
+        quantize = fields[0];
+        memcpy(&scale, data + sizeof(fields), sizeof(float));
+        const float *values = (const float *)(data + sizeof(fields) + sizeof(float));
+        mean = Mat(1, cols, CV_32F, (void *)values).clone();
+        eigenvectors = rows ? Mat(rows, cols, CV_32F, (void *)(values + cols)).clone() : Mat();
+        return true;
+}
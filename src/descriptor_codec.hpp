@@ -0,0 +1,60 @@
+#ifndef DESCRIPTOR_CODEC_HPP
+#define DESCRIPTOR_CODEC_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "descriptor_model.hpp"
+
+// model section holding the codec the rows were compressed with
+const uint32_t MODEL_SECTION_CODEC = modelTag('C', 'O', 'D', 'C');
+
+enum DescriptorQuantization {
+        QUANTIZE_NONE = 0,
+        QUANTIZE_INT8 = 1,
+        QUANTIZE_FP16 = 2
+};
+
+// "none", "int8" or "fp16", -1 for anything else
+int quantizationByName(const std::string &name);
+
+// Compact form of float descriptors, fitted once on the training set: an
+// optional PCA projection to fewer dimensions, then optional quantization
+// to int8 (one scale for every dimension, so distances keep their ratios)
+// or IEEE half floats stored as CV_16U. Good matches are counted directly
+// on the compact rows, by an exact two nearest neighbour scan over squared
+// L2 distances, with the ratio test applied to the square of the
+// coefficient so it matches the L2 distances of the FLANN matcher.
+class DescriptorCodec {
+public:
+        // dims <= 0 keeps every dimension
+        void fit(const cv::Mat &descriptors, int dims, int quantization);
+
+        bool enabled() const { return !mean.empty(); }
+        int quantization() const { return quantize; }
+        int dims() const { return eigenvectors.empty() ? mean.cols : eigenvectors.rows; }
+
+        // compact rows of float descriptors, and float rows of compact ones
+        void encode(const cv::Mat &descriptors, cv::Mat &encoded) const;
+        void decode(const cv::Mat &encoded, cv::Mat &descriptors) const;
+
+        int countGoodMatches(const cv::Mat &query, const cv::Mat &train, double distCoeff) const;
+
+        std::vector<char> serialize() const;
+        bool deserialize(const char *data, size_t length);
+
+private:
+        int quantize = QUANTIZE_NONE;
+        float scale = 1;
+        cv::Mat mean;
+        cv::Mat eigenvectors;
+};
+
+// exact two nearest neighbour good match count of float rows, the
+// uncompressed reference compact matching is compared with
+int countGoodMatchesExact(const cv::Mat &query, const cv::Mat &train, double distCoeff);
+
+#endif
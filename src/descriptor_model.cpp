@@ -0,0 +1,233 @@
+#include <climits>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "descriptor_model.hpp"
+
+using namespace std;
+using namespace cv;
+
+static const char MODEL_MAGIC[4] = {'N', 'D', 'D', 'M'};
+
+// keeps the descriptor block cache line aligned inside the mapping
+static const uint64_t DATA_ALIGNMENT = 64;
+
+static_assert(sizeof(ModelHeader) == 64, "model header must stay 64 bytes");
+
+static void padTo(ofstream &file, uint64_t alignment) {
+        uint64_t position = file.tellp();
+        static const char zeros[DATA_ALIGNMENT] = {0};
+        if (position % alignment != 0) {
+                file.write(zeros, alignment - position % alignment);
+        }
+}
+
+DescriptorModelWriter::~DescriptorModelWriter() {
+        if (file.is_open()) {
+                close();
+        }
+}
+
+bool DescriptorModelWriter::open(const string &path) {
+        file.open(path.c_str(), ios::binary | ios::trunc);
+        if (!file.is_open()) {
+                return false;
+        }
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+        header.version = MODEL_VERSION;
+        header.type = -1;
+        entries.clear();
+        sections.clear();
+
+        // placeholder, rewritten by close()
+        file.write((const char *)&header, sizeof(header));
+        padTo(file, DATA_ALIGNMENT);
+        header.dataOffset = file.tellp();
+        return true;
+}
+
+void DescriptorModelWriter::add(const Mat &descriptors) {
+        ModelEntry entry;
+        entry.firstRow = header.totalRows;
+        entry.rows = descriptors.empty() ? 0 : descriptors.rows;
+        entries.push_back(entry);
+
+        if (entry.rows == 0) {
+                return;
+        }
+
+        // every image must share the layout of the first one
+        if (header.type < 0) {
+                header.type = descriptors.type();
+                header.cols = descriptors.cols;
+        }
+        CV_Assert(descriptors.type() == header.type && descriptors.cols == (int)header.cols);
+
+        auto rowBytes = descriptors.cols * descriptors.elemSize();
+        for (int i = 0; i < descriptors.rows; i++) {
+                file.write((const char *)descriptors.ptr(i), rowBytes);
+        }
+        header.totalRows += entry.rows;
+}
+
+void DescriptorModelWriter::addSection(uint32_t tag, const vector<char> &bytes) {
+        sections.push_back(make_pair(tag, bytes));
+}
+
+bool DescriptorModelWriter::close() {
+        if (header.type < 0) {
+                // no descriptors at all, keep the layout of the SURF default
+                header.type = CV_32F;
+        }
+
+        vector<ModelSection> sectionTable;
+        for (auto &section : sections) {
+                padTo(file, DATA_ALIGNMENT);
+                ModelSection entry;
+                entry.tag = section.first;
+                entry.reserved = 0;
+                entry.offset = file.tellp();
+                entry.size = section.second.size();
+                file.write(section.second.data(), section.second.size());
+                sectionTable.push_back(entry);
+        }
+
+        padTo(file, DATA_ALIGNMENT);
+        header.imageCount = entries.size();
+        header.tableOffset = file.tellp();
+        file.write((const char *)entries.data(), entries.size() * sizeof(ModelEntry));
+
+        header.sectionCount = sectionTable.size();
+        header.sectionsOffset = file.tellp();
+        file.write((const char *)sectionTable.data(), sectionTable.size() * sizeof(ModelSection));
+
+        file.seekp(0);
+        file.write((const char *)&header, sizeof(header));
+        file.close();
+        return !file.fail();
+}
+
+// whether count items of unit bytes starting at offset lie inside size
+// bytes, without overflowing on values read from a corrupt file
+static bool fitsIn(uint64_t offset, uint64_t count, uint64_t unit, uint64_t size) {
+        return offset <= size && (unit == 0 || count <= (size - offset) / unit);
+}
+
+DescriptorModel::~DescriptorModel() {
+        close();
+}
+
+bool DescriptorModel::open(const string &path) {
+        close();
+
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+                return false;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(ModelHeader)) {
+                ::close(fd);
+                return false;
+        }
+
+        // pages are only faulted in when a matrix is touched, so opening
+        // is constant time and repeated runs share the page cache
+        mappingSize = info.st_size;
+        mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+                mapping = nullptr;
+                return false;
+        }
+
+        header = (const ModelHeader *)mapping;
+        if (memcmp(header->magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0
+            || header->version != MODEL_VERSION) {
+                close();
+                return false;
+        }
+
+        // nothing read from the file is trusted: every table, row range and
+        // section must lie inside the mapping, and the tables must be
+        // aligned for their 64-bit fields
+        bool validLayout = header->type == CV_MAT_TYPE(header->type)
+                           && header->cols <= INT_MAX && header->totalRows <= INT_MAX
+                           && (header->cols > 0 || header->totalRows == 0);
+        uint64_t rowBytes = validLayout ? (uint64_t)header->cols * CV_ELEM_SIZE(header->type) : 0;
+        bool fits = validLayout
+                    && fitsIn(header->dataOffset, header->totalRows, rowBytes, mappingSize)
+                    && header->tableOffset % sizeof(uint64_t) == 0
+                    && fitsIn(header->tableOffset, header->imageCount, sizeof(ModelEntry), mappingSize)
+                    && header->sectionsOffset % sizeof(uint64_t) == 0
+                    && fitsIn(header->sectionsOffset, header->sectionCount, sizeof(ModelSection), mappingSize);
+        if (!fits) {
+                close();
+                return false;
+        }
+
+        const ModelEntry *entryTable = (const ModelEntry *)((const char *)mapping + header->tableOffset);
+        for (uint32_t i = 0; i < header->imageCount; i++) {
+                if (entryTable[i].firstRow > header->totalRows
+                    || entryTable[i].rows > header->totalRows - entryTable[i].firstRow) {
+                        close();
+                        return false;
+                }
+        }
+        const ModelSection *sections = (const ModelSection *)((const char *)mapping + header->sectionsOffset);
+        for (uint32_t i = 0; i < header->sectionCount; i++) {
+                if (!fitsIn(sections[i].offset, sections[i].size, 1, mappingSize)) {
+                        close();
+                        return false;
+                }
+        }
+
+        entries = entryTable;
+        sectionTable = sections;
+        return true;
+}
+
+void DescriptorModel::close() {
+        if (mapping) {
+                munmap(mapping, mappingSize);
+        }
+        mapping = nullptr;
+        mappingSize = 0;
+        header = nullptr;
+        entries = nullptr;
+        sectionTable = nullptr;
+}
+
+Mat DescriptorModel::rows(uint64_t first, uint64_t count) const {
+        if (count == 0) {
+                return Mat();
+        }
+        size_t rowBytes = header->cols * CV_ELEM_SIZE(header->type);
+        auto data = (uchar *)mapping + header->dataOffset + first * rowBytes;
+        return Mat(count, header->cols, header->type, data, rowBytes);
+}
+
+Mat DescriptorModel::descriptors(size_t image) const {
+        return rows(entries[image].firstRow, entries[image].rows);
+}
+
+Mat DescriptorModel::all() const {
+        return rows(0, header->totalRows);
+}
+
+bool DescriptorModel::section(uint32_t tag, const char *&data, size_t &length) const {
+        for (uint32_t i = 0; i < header->sectionCount; i++) {
+                if (sectionTable[i].tag == tag) {
+                        data = (const char *)mapping + sectionTable[i].offset;
+                        length = sectionTable[i].size;
+                        return true;
+                }
+        }
+        return false;
+}
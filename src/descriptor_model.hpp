@@ -0,0 +1,112 @@
+#ifndef DESCRIPTOR_MODEL_HPP
+#define DESCRIPTOR_MODEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+// Binary descriptor model, replacing the template.xml FileStorage dump.
+//
+// file layout (all integers little endian, as written by the host):
+//   ModelHeader                         64 bytes
+//   descriptor rows of every image      contiguous, starts at dataOffset
+//   extension sections                  opaque blobs tagged with a fourcc
+//   ModelEntry[imageCount]              first row and row count per image
+//   ModelSection[sectionCount]          tag, offset and size per section
+//
+// Rows of consecutive images follow each other without padding, so the
+// whole training set is also usable as a single stacked matrix.
+
+const uint32_t MODEL_VERSION = 1;
+
+inline uint32_t modelTag(char a, char b, char c, char d) {
+        return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8)
+               | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+}
+
+struct ModelHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t imageCount;
+        uint32_t sectionCount;
+        int32_t type;
+        uint32_t cols;
+        uint64_t totalRows;
+        uint64_t dataOffset;
+        uint64_t tableOffset;
+        uint64_t sectionsOffset;
+        uint8_t reserved[8];
+};
+
+struct ModelEntry {
+        uint64_t firstRow;
+        uint64_t rows;
+};
+
+struct ModelSection {
+        uint32_t tag;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+};
+
+// streams descriptor matrices to disk, one call to add() per training image
+class DescriptorModelWriter {
+public:
+        DescriptorModelWriter() {}
+        ~DescriptorModelWriter();
+
+        bool open(const std::string &path);
+        void add(const cv::Mat &descriptors);
+        void addSection(uint32_t tag, const std::vector<char> &bytes);
+        bool close();
+
+private:
+        DescriptorModelWriter(const DescriptorModelWriter &) = delete;
+        DescriptorModelWriter &operator=(const DescriptorModelWriter &) = delete;
+
+        std::ofstream file;
+        ModelHeader header;
+        std::vector<ModelEntry> entries;
+        std::vector<std::pair<uint32_t, std::vector<char> > > sections;
+};
+
+// read-only memory mapping of a model file; matrices returned by
+// descriptors() and all() point straight into the mapping and must
+// not be written to
+class DescriptorModel {
+public:
+        DescriptorModel() {}
+        ~DescriptorModel();
+
+        bool open(const std::string &path);
+        void close();
+
+        size_t size() const { return entries ? header->imageCount : 0; }
+        int type() const { return header->type; }
+        int cols() const { return header->cols; }
+        size_t totalRows() const { return header->totalRows; }
+        size_t firstRow(size_t image) const { return entries[image].firstRow; }
+
+        cv::Mat descriptors(size_t image) const;
+        cv::Mat all() const;
+        bool section(uint32_t tag, const char *&data, size_t &length) const;
+
+private:
+        DescriptorModel(const DescriptorModel &) = delete;
+        DescriptorModel &operator=(const DescriptorModel &) = delete;
+
+        cv::Mat rows(uint64_t first, uint64_t count) const;
+
+        void *mapping = nullptr;
+        size_t mappingSize = 0;
+        const ModelHeader *header = nullptr;
+        const ModelEntry *entries = nullptr;
+        const ModelSection *sectionTable = nullptr;
+};
+
+#endif
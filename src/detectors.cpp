@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include "detectors.hpp"
+#include "hue_correlation.hpp"
+#include "object_analysis.hpp"
+#include "shape_detector.hpp"
+#include "surf_detector.hpp"
+
+using namespace std;
+using namespace cv;
+
+static bool globTraining(const Options &options, vector<string> &fileNames) {
+        string trainingDir = options.get("training");
+        if (trainingDir.empty()) {
+                cerr << "No training directory given (--training=<dir>)" << endl;
+                return false;
+        }
+        glob(trainingDir + "/*.jpg", fileNames, false);
+        return true;
+}
+
+class ShapeDetector : public Detector {
+public:
+        int views() const {
+                return FRAME_GRAY;
+        }
+
+        bool prepare(const Options &, ThreadPool &) {
+                return true;
+        }
+
+        int classify(Frame &frame) const {
+                int numberOfSides = countPolygonSides(frame.gray());
+                return numberOfSides < 0 ? VERDICT_UNUSABLE : shapeVerdict(numberOfSides);
+        }
+};
+
+class SurfDetector : public Detector {
+public:
+        int views() const {
+                return FRAME_GRAY | FRAME_BGR;
+        }
+
+        bool prepare(const Options &options, ThreadPool &) {
+                string modelPath = options.get("model", "template.ndm");
+
+                if (!options.has("no-train")) {
+                        vector<string> fileNames;
+                        if (!globTraining(options, fileNames)) {
+                                return false;
+                        }
+                        FeatureModelParams params;
+                        if (!parseFeatureModelParams(options, params)) {
+                                return false;
+                        }
+                        if (!trainFeatureModel(fileNames, modelPath, params, options.getInt("workers", 1))) {
+                                cerr << "Cannot write model " << modelPath << endl;
+                                return false;
+                        }
+                }
+
+                if (!matcher.open(modelPath, options.has("global-index"))) {
+                        cerr << "Cannot read model " << modelPath << endl;
+                        return false;
+                }
+                int acceptable = options.getInt("acceptable-match", acceptableMatch(matcher.backend()));
+                addSurfGates(cascade, matcher, acceptable);
+                return true;
+        }
+
+        int classify(Frame &frame) const {
+                return cascade.run(frame) ? VERDICT_KNOWN : VERDICT_NOVEL;
+        }
+
+private:
+        FeatureMatcher matcher;
+        // measures its gates as requests go through, shared by the workers
+        mutable GateCascade<Frame> cascade;
+};
+
+class HueDetector : public Detector {
+public:
+        int views() const {
+                return OBJECT_ANALYSIS_VIEWS;
+        }
+
+        bool prepare(const Options &options, ThreadPool &pool) {
+                vector<string> fileNames;
+                if (!globTraining(options, fileNames)) {
+                        return false;
+                }
+                FeatureCache cache;
+                string cacheDirectory = options.get("feature-cache");
+                if (!cacheDirectory.empty() && !cache.open(cacheDirectory, OBJECT_HUE_FEATURES)) {
+                        cerr << "Cannot open feature cache " << cacheDirectory << endl;
+                        return false;
+                }
+                training = analyzeImages(fileNames, &pool, OBJECT_HUE_FEATURES, cacheDirectory.empty() ? nullptr : &cache);
+                hueIndex.reset(new HueCorrelationIndex(training.hueHists.data(), training.size(), HUE_HIST_BINS));
+                return true;
+        }
+
+        int classify(Frame &frame) const {
+                ObjectData data;
+                analyzeImage(frame, data, false, OBJECT_HUE_FEATURES);
+                int matches = hueIndex->countMatches(data.hueHist, HUE_HIST_MIN_CORREL, HUE_HIST_MIN_MATCHES);
+                return matches >= HUE_HIST_MIN_MATCHES ? VERDICT_KNOWN : VERDICT_NOVEL;
+        }
+
+private:
+        ObjectTable training;
+        unique_ptr<HueCorrelationIndex> hueIndex;
+};
+
+unique_ptr<Detector> createDetector(const string &name) {
+        if (name == "shape") {
+                return unique_ptr<Detector>(new ShapeDetector());
+        }
+        if (name == "surf") {
+                return unique_ptr<Detector>(new SurfDetector());
+        }
+        if (name == "hue") {
+                return unique_ptr<Detector>(new HueDetector());
+        }
+        return nullptr;
+}
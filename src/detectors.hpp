@@ -0,0 +1,39 @@
+#ifndef DETECTORS_HPP
+#define DETECTORS_HPP
+
+#include <memory>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+#include "frame.hpp"
+#include "options.hpp"
+#include "thread_pool.hpp"
+
+const int VERDICT_KNOWN = 0;
+const int VERDICT_NOVEL = 1;
+const int VERDICT_UNUSABLE = -1;
+
+// One of the set1/set2/set3 checks packaged as a plug-in of the nd
+// service: the training side is prepared once, then every frame is
+// decoded once and handed to each active detector in turn.
+class Detector {
+public:
+        virtual ~Detector() {}
+
+        // FrameViews the detector reads
+        virtual int views() const = 0;
+
+        // builds or loads the training side, reports problems on stderr
+        virtual bool prepare(const Options &options, ThreadPool &pool) = 0;
+
+        // VERDICT_KNOWN, VERDICT_NOVEL or VERDICT_UNUSABLE when the image
+        // cannot be analyzed; safe to call from several threads as long as
+        // each uses its own frame
+        virtual int classify(Frame &frame) const = 0;
+};
+
+// "shape" (set1), "surf" (set2) or "hue" (set3), null for other names
+std::unique_ptr<Detector> createDetector(const std::string &name);
+
+#endif
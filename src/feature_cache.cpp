@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "feature_cache.hpp"
+#include "metrics.hpp"
+#include "object_analysis.hpp"
+
+using namespace std;
+using namespace cv;
+
+const char RECORD_MAGIC[4] = {'N', 'D', 'F', 'C'};
+const char *RECORD_EXTENSION = ".ndf";
+
+uint64_t hashBytes(const void *data, size_t length, uint64_t seed) {
+        const uint64_t MULTIPLIER = 0x9e3779b97f4a7c15ull;
+        const unsigned char *bytes = (const unsigned char *)data;
+        uint64_t hash = seed ^ (length * MULTIPLIER);
+
+        for (; length >= 8; bytes += 8, length -= 8) {
+                uint64_t word;
+                memcpy(&word, bytes, sizeof(word));
+                hash = (hash ^ word) * MULTIPLIER;
+                hash ^= hash >> 29;
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, bytes, length);
+        hash = (hash ^ tail) * MULTIPLIER;
+
+        // final avalanche, every input bit reaches every output bit
+        hash ^= hash >> 32;
+        hash *= 0xd6e8feb86659fd93ull;
+        hash ^= hash >> 32;
+        return hash;
+}
+
+static string hexString(uint64_t value) {
+        ostringstream text;
+        text << hex << setw(16) << setfill('0') << value;
+        return text.str();
+}
+
+// every constant the analysis reads, a change to any of them gives new keys
+static uint64_t parameterHash(int features) {
+        ostringstream parameters;
+        parameters << FEATURE_CACHE_VERSION << ' ' << features << ' ' << LOW_THRESHOLD << ' ' << THRESH_RATIO << ' '
+                   << CANNY_KERNEL_SIZE << ' ' << BLUR_KERNEL_SIZE << ' ' << CONTOUR_MAX_SIGMA << ' '
+                   << HU_MOMENTS << ' ' << HUE_HIST_BINS << ' ' << sizeof(ObjectData);
+        string text = parameters.str();
+        return hashBytes(text.data(), text.size());
+}
+
+bool FeatureCache::open(const string &cacheDirectory, int features) {
+        directory = cacheDirectory;
+        prefix = hexString(parameterHash(features)) + "-";
+
+        if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST) {
+                return false;
+        }
+
+        // records of other parameters can never be hit again, and records
+        // still written aside were left by a run that did not finish
+        DIR *entries = opendir(directory.c_str());
+        if (!entries) {
+                return false;
+        }
+        string temporarySuffix = string(RECORD_EXTENSION) + ".tmp";
+        while (dirent *entry = readdir(entries)) {
+                string name = entry->d_name;
+                bool record = name.size() > strlen(RECORD_EXTENSION)
+                              && name.compare(name.size() - strlen(RECORD_EXTENSION), string::npos, RECORD_EXTENSION) == 0;
+                bool temporary = name.find(temporarySuffix) != string::npos;
+                if (temporary || (record && name.compare(0, prefix.size(), prefix) != 0)) {
+                        remove((directory + "/" + name).c_str());
+                        ND_COUNT("feature_cache_evictions", 1);
+                }
+        }
+        closedir(entries);
+        return true;
+}
+
+string FeatureCache::recordPath(const Mat &encodedImage) const {
+        uint64_t contentHash = hashBytes(encodedImage.ptr(), encodedImage.total() * encodedImage.elemSize());
+        return directory + "/" + prefix + hexString(contentHash) + RECORD_EXTENSION;
+}
+
+// record layout: magic, then the fields of ObjectData as stored in memory
+bool FeatureCache::lookup(const Mat &encodedImage, ObjectData &data) const {
+        ifstream file(recordPath(encodedImage).c_str(), ios::binary);
+        char magic[sizeof(RECORD_MAGIC)];
+        bool hit = file.read(magic, sizeof(magic)) && memcmp(magic, RECORD_MAGIC, sizeof(magic)) == 0
+                   && file.read((char *)data.hu, sizeof(data.hu))
+                   && file.read((char *)&data.roundness, sizeof(data.roundness))
+                   && file.read((char *)data.hueHist, sizeof(data.hueHist))
+                   && file.read((char *)&data.flags, sizeof(data.flags));
+        if (hit) {
+                ND_COUNT("feature_cache_hits", 1);
+        } else {
+                ND_COUNT("feature_cache_misses", 1);
+        }
+        return hit;
+}
+
+string FeatureCache::trainingSetPath(uint64_t key) const {
+        return directory + "/" + prefix + "set-" + hexString(key) + RECORD_EXTENSION;
+}
+
+// training set record layout: magic, the length as uint64, the bytes
+bool FeatureCache::lookupTrainingSet(uint64_t key, vector<char> &bytes) const {
+        ifstream file(trainingSetPath(key).c_str(), ios::binary);
+        char magic[sizeof(RECORD_MAGIC)];
+        uint64_t length = 0;
+        bool hit = file.read(magic, sizeof(magic)) && memcmp(magic, RECORD_MAGIC, sizeof(magic)) == 0
+                   && file.read((char *)&length, sizeof(length));
+        if (hit) {
+                file.seekg(0, ios::end);
+                hit = (uint64_t)file.tellg() == sizeof(magic) + sizeof(length) + length;
+                file.seekg(sizeof(magic) + sizeof(length));
+        }
+        if (hit) {
+                bytes.resize(length);
+                hit = length == 0 || file.read(bytes.data(), length);
+        }
+        if (hit) {
+                ND_COUNT("feature_cache_hits", 1);
+        } else {
+                ND_COUNT("feature_cache_misses", 1);
+        }
+        return hit;
+}
+
+void FeatureCache::storeTrainingSet(uint64_t key, const vector<char> &bytes) const {
+        string path = trainingSetPath(key);
+        ostringstream temporary;
+        temporary << path << ".tmp" << this_thread::get_id();
+
+        uint64_t length = bytes.size();
+        ofstream file(temporary.str().c_str(), ios::binary);
+        file.write(RECORD_MAGIC, sizeof(RECORD_MAGIC));
+        file.write((const char *)&length, sizeof(length));
+        file.write(bytes.data(), bytes.size());
+        file.close();
+        if (!file) {
+                remove(temporary.str().c_str());
+                return;
+        }
+        rename(temporary.str().c_str(), path.c_str());
+}
+
+void FeatureCache::store(const Mat &encodedImage, const ObjectData &data) const {
+        string path = recordPath(encodedImage);
+        ostringstream temporary;
+        temporary << path << ".tmp" << this_thread::get_id();
+
+        // closed before checking, a failed flush must not be renamed in
+        ofstream file(temporary.str().c_str(), ios::binary);
+        file.write(RECORD_MAGIC, sizeof(RECORD_MAGIC));
+        file.write((const char *)data.hu, sizeof(data.hu));
+        file.write((const char *)&data.roundness, sizeof(data.roundness));
+        file.write((const char *)data.hueHist, sizeof(data.hueHist));
+        file.write((const char *)&data.flags, sizeof(data.flags));
+        file.close();
+        if (!file) {
+                remove(temporary.str().c_str());
+                return;
+        }
+        rename(temporary.str().c_str(), path.c_str());
+}
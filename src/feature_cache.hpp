@@ -0,0 +1,46 @@
+#ifndef FEATURE_CACHE_HPP
+#define FEATURE_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "object_data.hpp"
+
+// bumped whenever the analysis changes in a way its constants don't show
+const uint32_t FEATURE_CACHE_VERSION = 1;
+
+// 64-bit hash of a byte buffer, eight bytes per step
+uint64_t hashBytes(const void *data, size_t length, uint64_t seed = 0);
+
+// On-disk cache of analyzeImage() results, one small record file per
+// image. A record is named after a hash of the analysis parameters and a
+// hash of the encoded file, so an edited image gets a new record and an
+// unchanged one is found again whatever its name. Opening the cache
+// removes the records written under other parameters and the temporary
+// files of an unfinished run. Lookups and stores may happen from several
+// threads; records are written aside and renamed into place. Data
+// derived from a whole training set, such as its hue prototypes, is kept
+// the same way under a key hashed from that set.
+class FeatureCache {
+public:
+        // features is the analyzeImage() feature mask, part of the key
+        bool open(const std::string &directory, int features);
+
+        bool lookup(const cv::Mat &encodedImage, ObjectData &data) const;
+        void store(const cv::Mat &encodedImage, const ObjectData &data) const;
+
+        bool lookupTrainingSet(uint64_t key, std::vector<char> &bytes) const;
+        void storeTrainingSet(uint64_t key, const std::vector<char> &bytes) const;
+
+private:
+        std::string recordPath(const cv::Mat &encodedImage) const;
+        std::string trainingSetPath(uint64_t key) const;
+
+        std::string directory;
+        std::string prefix;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#include <algorithm>
+
+#include <opencv2/opencv_modules.hpp>
+
+#ifdef HAVE_OPENCV_NONFREE
+#include <opencv2/nonfree/features2d.hpp>
+#endif
+
+#include "features.hpp"
+#include "metrics.hpp"
+#include "surf_detector.hpp"
+
+using namespace std;
+using namespace cv;
+
+string defaultFeatureBackend() {
+#ifdef HAVE_OPENCV_NONFREE
+        return "surf";
+#else
+        return "orb";
+#endif
+}
+
+bool FeatureExtractor::create(const string &backend) {
+        if (backend == "surf") {
+#ifdef HAVE_OPENCV_NONFREE
+                detector = new SurfFeatureDetector(MIN_HESSIAN);
+                extractor = new SurfDescriptorExtractor();
+#else
+                return false;
+#endif
+        } else if (backend == "orb") {
+                detector = new ORB(ORB_FEATURES);
+                extractor = new ORB(ORB_FEATURES);
+        } else if (backend == "brisk") {
+                detector = new BRISK();
+                extractor = new BRISK();
+        } else {
+                return false;
+        }
+        name = backend;
+        return true;
+}
+
+void FeatureExtractor::compute(const Mat &grayImage, vector<KeyPoint> &keypoints, Mat &descriptors) const {
+        ND_TIMED_SCOPE("features");
+        detector->detect(grayImage, keypoints);
+        if (budget > 0 && (int)keypoints.size() > budget) {
+                // fewer descriptors to extract, store and match against
+                partial_sort(keypoints.begin(), keypoints.begin() + budget, keypoints.end(),
+                             [](const KeyPoint &a, const KeyPoint &b) { return a.response > b.response; });
+                keypoints.resize(budget);
+        }
+        extractor->compute(grayImage, keypoints, descriptors);
+        ND_COUNT("keypoints", keypoints.size());
+        ND_COUNT("descriptors", descriptors.rows);
+}
@@ -0,0 +1,44 @@
+#ifndef FEATURES_HPP
+#define FEATURES_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+// keypoints kept per image by the ORB backend
+const int ORB_FEATURES = 500;
+
+// "surf" when OpenCV was built with the nonfree module, "orb" otherwise
+std::string defaultFeatureBackend();
+
+// Keypoint detector and descriptor extractor pair used by set2. "surf"
+// gives 64 float descriptors matched by L2 distance; "orb" and "brisk"
+// give bit string descriptors matched by Hamming distance. Detection
+// only reads the configured parameters, so one extractor can serve
+// several threads.
+class FeatureExtractor {
+public:
+        // false when the backend is unknown or not built in
+        bool create(const std::string &backend);
+
+        const std::string &backend() const { return name; }
+
+        // descriptors are CV_8U bit strings compared by Hamming distance
+        bool binary() const { return name != "surf"; }
+
+        // keeps only the n strongest keypoints by detector response, 0 keeps all
+        void setKeypointBudget(int n) { budget = n; }
+        int keypointBudget() const { return budget; }
+
+        void compute(const cv::Mat &grayImage, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors) const;
+
+private:
+        std::string name;
+        int budget = 0;
+        cv::Ptr<cv::FeatureDetector> detector;
+        cv::Ptr<cv::DescriptorExtractor> extractor;
+};
+
+#endif
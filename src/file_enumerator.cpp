@@ -0,0 +1,74 @@
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "file_enumerator.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+
+NumberedFile::NumberedFile(const string &path) : number(LONG_MAX), path(path) {
+        const char *name = path.c_str() + path.find_last_of('/') + 1;
+        char *end;
+        long parsed = strtol(name, &end, 10);
+        if (end != name) {
+                number = parsed;
+        }
+}
+
+void sortByFileNumber(vector<string> &paths) {
+        vector<NumberedFile> files(paths.begin(), paths.end());
+        sort(files.begin(), files.end());
+        for (size_t i = 0; i < files.size(); i++) {
+                paths[i] = move(files[i].path);
+        }
+}
+
+DirectoryEnumerator::~DirectoryEnumerator() {
+        // unblocks the lister when the consumer stopped early
+        queue.close();
+        if (lister.joinable()) {
+                lister.join();
+        }
+}
+
+bool DirectoryEnumerator::start(const string &directory, const string &suffix) {
+        DIR *entries = opendir(directory.c_str());
+        if (!entries) {
+                return false;
+        }
+
+        lister = thread([this, entries, directory, suffix] {
+                while (dirent *entry = readdir(entries)) {
+                        string name = entry->d_name;
+                        if (name.size() <= suffix.size()
+                            || name.compare(name.size() - suffix.size(), string::npos, suffix) != 0) {
+                                continue;
+                        }
+
+                        string path = directory + "/" + name;
+                        struct stat status;
+                        bool regular = entry->d_type == DT_REG
+                                       || ((entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) && stat(path.c_str(), &status) == 0
+                                           && S_ISREG(status.st_mode));
+                        if (!regular) {
+                                continue;
+                        }
+
+                        ND_COUNT("files_listed", 1);
+                        if (!queue.push(NumberedFile(path))) {
+                                break;
+                        }
+                }
+                closedir(entries);
+                queue.close();
+        });
+        return true;
+}
+
+bool DirectoryEnumerator::next(NumberedFile &file) {
+        return queue.pop(file);
+}
@@ -0,0 +1,99 @@
+#ifndef FILE_ENUMERATOR_HPP
+#define FILE_ENUMERATOR_HPP
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bounded_queue.hpp"
+
+// file names found by the enumerator ahead of the processing
+const int ENUMERATION_QUEUE_DEPTH = 1024;
+
+// A path with the leading integer of its base name, parsed once ("12.jpg"
+// is 12). Names without one sort after every numbered name; equal numbers
+// sort by path.
+struct NumberedFile {
+        long number;
+        std::string path;
+
+        explicit NumberedFile(const std::string &path = "");
+
+        bool operator<(const NumberedFile &other) const {
+                return number != other.number ? number < other.number : path < other.path;
+        }
+};
+
+// sorts paths by the number of their base name, each name parsed once
+void sortByFileNumber(std::vector<std::string> &paths);
+
+// Lists the files of a directory whose names end with a suffix, reading
+// the directory on a thread of its own, so the first files can be
+// processed while a large directory is still being listed. Files come in
+// directory order.
+class DirectoryEnumerator {
+public:
+        DirectoryEnumerator() : queue(ENUMERATION_QUEUE_DEPTH) {}
+        ~DirectoryEnumerator();
+
+        // false when the directory cannot be read
+        bool start(const std::string &directory, const std::string &suffix);
+
+        // blocks for the next file, false once the whole directory was listed
+        bool next(NumberedFile &file);
+
+private:
+        DirectoryEnumerator(const DirectoryEnumerator &) = delete;
+        DirectoryEnumerator &operator=(const DirectoryEnumerator &) = delete;
+
+        BoundedQueue<NumberedFile> queue;
+        std::thread lister;
+};
+
+// Reorder buffer giving back results produced in directory order, or any
+// other, in file number order. Every file is announced with expect() as
+// it is found; once finish() says no more will come, next() releases the
+// results in order as soon as the next one is in. Used from one thread.
+template <typename Result>
+class OrderedResults {
+public:
+        void expect(const NumberedFile &file) {
+                files.push_back(file);
+        }
+
+        void finish() {
+                std::sort(files.begin(), files.end());
+                finished = true;
+        }
+
+        void add(const NumberedFile &file, Result result) {
+                pending[file.path] = std::move(result);
+        }
+
+        // the next result in order, false while it is not known yet
+        bool next(std::string &path, Result &result) {
+                if (!finished || cursor == files.size()) {
+                        return false;
+                }
+                auto found = pending.find(files[cursor].path);
+                if (found == pending.end()) {
+                        return false;
+                }
+                path = found->first;
+                result = std::move(found->second);
+                pending.erase(found);
+                cursor++;
+                return true;
+        }
+
+private:
+        std::vector<NumberedFile> files;
+        std::unordered_map<std::string, Result> pending;
+        size_t cursor = 0;
+        bool finished = false;
+};
+
+#endif
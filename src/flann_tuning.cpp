@@ -0,0 +1,154 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <opencv2/features2d/features2d.hpp>
+
+#include "flann_tuning.hpp"
+
+using namespace std;
+using namespace cv;
+
+// configurations swept, KD-tree forests first, then k-means trees
+static vector<FlannConfig> candidateConfigs() {
+        vector<FlannConfig> configs;
+        for (int trees : {1, 2, 4, 8}) {
+                for (int checks : {16, 32, 64, 128}) {
+                        FlannConfig config;
+                        config.algorithm = FLANN_KDTREE;
+                        config.trees = trees;
+                        config.checks = checks;
+                        configs.push_back(config);
+                }
+        }
+        for (int branching : {16, 32}) {
+                for (int checks : {32, 64, 128}) {
+                        FlannConfig config;
+                        config.algorithm = FLANN_KMEANS;
+                        config.branching = branching;
+                        config.checks = checks;
+                        configs.push_back(config);
+                }
+        }
+        return configs;
+}
+
+// per query row the train row of its good match, -1 when the ratio test
+// fails; the same test as countGoodMatches()
+static void goodMatches(const vector<vector<DMatch> > &matches, int queryRows, double distCoeff,
+                        vector<int> &good) {
+        good.assign(queryRows, -1);
+        for (auto &match : matches) {
+                if (match.size() < 2) {
+                        continue;
+                }
+                if (match[0].distance <= distCoeff * match[1].distance) {
+                        good[match[0].queryIdx] = match[0].trainIdx;
+                }
+        }
+}
+
+struct TuningPair {
+        size_t query;
+        size_t train;
+        vector<int> truth;
+        int truthCount;
+};
+
+// queries spread over the given ones, each paired with training images
+// spread over the model
+static vector<TuningPair> samplePairs(const DescriptorModel &model, const vector<Mat> &queries,
+                                      const vector<int> &excluded) {
+        vector<TuningPair> pairs;
+        size_t queryStep = max<size_t>(1, queries.size() / FLANN_TUNING_QUERIES);
+        size_t trainStep = max<size_t>(1, model.size() / FLANN_TUNING_TRAINS);
+        for (size_t q = 0; q < queries.size() && q / queryStep < (size_t)FLANN_TUNING_QUERIES; q += queryStep) {
+                if (queries[q].rows == 0) {
+                        continue;
+                }
+                for (size_t t = 0; t < model.size(); t += trainStep) {
+                        if ((int)t == excluded[q] || model.descriptors(t).rows < 2) {
+                                continue;
+                        }
+                        TuningPair pair;
+                        pair.query = q;
+                        pair.train = t;
+                        pairs.push_back(pair);
+                }
+        }
+        return pairs;
+}
+
+FlannConfig tuneFlann(const DescriptorModel &model, const vector<Mat> &queries,
+                      const vector<int> &excluded, double distCoeff, double recallTarget,
+                      ostream &report) {
+        vector<TuningPair> pairs = samplePairs(model, queries, excluded);
+        if (pairs.empty()) {
+                report << "No query/training pairs to tune FLANN on, keeping " << FlannConfig().describe() << endl;
+                return FlannConfig();
+        }
+
+        BFMatcher exact(NORM_L2);
+        long truthTotal = 0;
+        double exactSeconds = 0;
+        for (auto &pair : pairs) {
+                vector<vector<DMatch> > matches;
+                auto start = chrono::steady_clock::now();
+                exact.knnMatch(queries[pair.query], model.descriptors(pair.train), matches, 2);
+                exactSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                goodMatches(matches, queries[pair.query].rows, distCoeff, pair.truth);
+                pair.truthCount = (int)(pair.truth.size() - count(pair.truth.begin(), pair.truth.end(), -1));
+                truthTotal += pair.truthCount;
+        }
+        report << "Tuning FLANN on " << pairs.size() << " pairs, " << truthTotal << " exact good matches, "
+               << 1e6 * exactSeconds / pairs.size() << " us per pair brute force" << endl;
+
+        FlannConfig fastest, mostAccurate;
+        double fastestSeconds = HUGE_VAL, bestRecall = -1;
+        for (const FlannConfig &config : candidateConfigs()) {
+                long found = 0, countDifference = 0;
+                int sameCounts = 0;
+                double seconds = 0;
+                vector<int> good;
+                for (auto &pair : pairs) {
+                        // a fresh matcher per pair, as countGoodMatches() builds one
+                        vector<vector<DMatch> > matches;
+                        auto start = chrono::steady_clock::now();
+                        FlannBasedMatcher matcher(config.indexParams(), config.searchParams());
+                        matcher.knnMatch(queries[pair.query], model.descriptors(pair.train), matches, 2);
+                        seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+                        goodMatches(matches, queries[pair.query].rows, distCoeff, good);
+                        int goodCount = 0;
+                        for (size_t row = 0; row < good.size(); row++) {
+                                goodCount += good[row] >= 0;
+                                found += good[row] >= 0 && good[row] == pair.truth[row];
+                        }
+                        sameCounts += goodCount == pair.truthCount;
+                        countDifference += abs(goodCount - pair.truthCount);
+                }
+
+                double recall = truthTotal ? (double)found / truthTotal : 1.0;
+                report << "  " << config.describe() << ": recall " << recall
+                       << ", same count " << sameCounts << "/" << pairs.size()
+                       << ", mean count difference " << (double)countDifference / pairs.size()
+                       << ", " << 1e6 * seconds / pairs.size() << " us per pair" << endl;
+
+                if (recall >= recallTarget && seconds < fastestSeconds) {
+                        fastest = config;
+                        fastestSeconds = seconds;
+                }
+                if (recall > bestRecall) {
+                        mostAccurate = config;
+                        bestRecall = recall;
+                }
+        }
+
+        if (fastestSeconds == HUGE_VAL) {
+                report << "No configuration reaches recall " << recallTarget << ", chosen "
+                       << mostAccurate.describe() << endl;
+                return mostAccurate;
+        }
+        report << "Chosen " << fastest.describe() << endl;
+        return fastest;
+}
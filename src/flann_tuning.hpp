@@ -0,0 +1,31 @@
+#ifndef FLANN_TUNING_HPP
+#define FLANN_TUNING_HPP
+
+#include <ostream>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "descriptor_model.hpp"
+#include "matching.hpp"
+
+// recall of brute force good matches a tuned configuration has to keep
+const double FLANN_RECALL_TARGET = 0.95;
+
+// query images and training images per query matched during tuning
+const int FLANN_TUNING_QUERIES = 8;
+const int FLANN_TUNING_TRAINS = 16;
+
+// Sweeps FLANN index types and parameters over a sample of query/training
+// pairs of a float descriptor model. Exact L2 matching gives the ground
+// truth; per configuration the recall of its ratio test matches, how
+// often countGoodMatches() gives the same count and the time per pair,
+// index build included, are written to report. excluded holds, per query,
+// a training image not to pair it with (its own image when the queries
+// come from the training set) or -1. Returns the fastest configuration
+// reaching recallTarget, or the one with the best recall when none does.
+FlannConfig tuneFlann(const DescriptorModel &model, const std::vector<cv::Mat> &queries,
+                      const std::vector<int> &excluded, double distCoeff, double recallTarget,
+                      std::ostream &report);
+
+#endif
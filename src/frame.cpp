@@ -0,0 +1,54 @@
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "frame.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+using namespace cv;
+
+int Frame::decodeFlags(int views) {
+        return (views & ~FRAME_GRAY) ? CV_LOAD_IMAGE_COLOR : CV_LOAD_IMAGE_GRAYSCALE;
+}
+
+void Frame::reset(const Mat &decoded, int views) {
+        primary = decoded;
+        bgrImage = Mat();
+        grayImage = Mat();
+
+        if (decodeFlags(views) == CV_LOAD_IMAGE_GRAYSCALE) {
+                grayImage = primary;
+        } else {
+                bgrImage = primary;
+        }
+}
+
+bool Frame::decode(const Mat &encodedImage, int views) {
+        ND_TIMED_SCOPE("decode");
+        // an unreadable file gives no bytes, imdecode() would assert on them
+        reset(encodedImage.empty() ? Mat() : imdecode(encodedImage, decodeFlags(views)), views);
+        return !empty();
+}
+
+bool Frame::load(const string &path, int views) {
+        ND_TIMED_SCOPE("decode");
+        reset(imread(path.c_str(), decodeFlags(views)), views);
+        return !empty();
+}
+
+bool Frame::assign(const Mat &image) {
+        reset(image, image.channels() == 1 ? FRAME_GRAY : FRAME_BGR);
+        return !empty();
+}
+
+const Mat &Frame::bgr() const {
+        CV_Assert(!bgrImage.empty());
+        return bgrImage;
+}
+
+const Mat &Frame::gray() {
+        if (grayImage.empty() && !bgrImage.empty()) {
+                cvtColor(bgrImage, grayImage, CV_BGR2GRAY);
+        }
+        return grayImage;
+}
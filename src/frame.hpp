@@ -0,0 +1,42 @@
+#ifndef FRAME_HPP
+#define FRAME_HPP
+
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+// views of an image a detector can ask for
+enum FrameViews {
+        FRAME_GRAY = 1 << 0,
+        FRAME_BGR = 1 << 1
+};
+
+// An image decoded once and shared by every detector looking at it. The
+// file is decoded straight to grayscale when nothing else is needed,
+// otherwise to BGR; the gray view is then derived on first use.
+// A frame is meant to be used by one thread at a time.
+class Frame {
+public:
+        bool decode(const cv::Mat &encodedImage, int views);
+        bool load(const std::string &path, int views);
+        // an image decoded elsewhere, gray or BGR, shared without a copy
+        bool assign(const cv::Mat &image);
+
+        bool empty() const { return primary.empty(); }
+
+        const cv::Mat &bgr() const;
+        const cv::Mat &gray();
+
+        // whether the gray view is already available without a conversion
+        bool hasGray() const { return !grayImage.empty(); }
+
+private:
+        static int decodeFlags(int views);
+        void reset(const cv::Mat &decoded, int views);
+
+        cv::Mat primary;
+        cv::Mat bgrImage;
+        cv::Mat grayImage;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include "frame_source.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+using namespace cv;
+
+class CaptureSource : public FrameSource {
+public:
+        bool open(const string &location) {
+                device = location.find_first_not_of("0123456789") == string::npos;
+                return device ? capture.open(stoi(location)) : capture.open(location);
+        }
+
+        bool read(Mat &frame) {
+                ND_TIMED_SCOPE("decode");
+                if (capture.read(frame)) {
+                        failures = 0;
+                        return true;
+                }
+
+                // a file ends at its last frame, a bad frame before it is
+                // skipped; a device may just not have had a frame ready
+                if (!device) {
+                        double frames = capture.get(CV_CAP_PROP_FRAME_COUNT);
+                        if (frames <= 0 || capture.get(CV_CAP_PROP_POS_FRAMES) >= frames) {
+                                return false;
+                        }
+                }
+                frame = Mat();
+                return ++failures < CAPTURE_RETRY_LIMIT;
+        }
+
+private:
+        VideoCapture capture;
+        bool device = false;
+        int failures = 0;
+};
+
+// fixed size frames back to back, as written by e.g. ffmpeg -f rawvideo
+class RawSource : public FrameSource {
+public:
+        ~RawSource() {
+                if (fd > STDIN_FILENO) {
+                        close(fd);
+                }
+        }
+
+        bool open(const string &location, int width, int height, int channels) {
+                fd = location == "-" ? STDIN_FILENO : ::open(location.c_str(), O_RDONLY);
+                this->width = width;
+                this->height = height;
+                this->channels = channels;
+                return fd >= 0;
+        }
+
+        bool read(Mat &frame) {
+                ND_TIMED_SCOPE("decode");
+                // a new buffer per frame, the last one may still be queued
+                frame = Mat(height, width, CV_8UC(channels));
+                size_t wanted = frame.total() * frame.elemSize();
+                size_t filled = 0;
+                while (filled < wanted) {
+                        ssize_t count = ::read(fd, frame.ptr() + filled, wanted - filled);
+                        if (count < 0 && errno == EINTR) {
+                                continue;
+                        }
+                        if (count <= 0) {
+                                // a partial frame at the end is dropped
+                                return false;
+                        }
+                        filled += count;
+                }
+                return true;
+        }
+
+private:
+        int fd = -1;
+        int width = 0;
+        int height = 0;
+        int channels = 1;
+};
+
+unique_ptr<FrameSource> openFrameSource(const string &location, const string &rawFormat) {
+        if (rawFormat.empty()) {
+                unique_ptr<CaptureSource> source(new CaptureSource());
+                if (!source->open(location)) {
+                        cerr << "Cannot open video " << location << endl;
+                        return nullptr;
+                }
+                return move(source);
+        }
+
+        int width = 0, height = 0, channels = 1;
+        int fields = sscanf(rawFormat.c_str(), "%dx%dx%d", &width, &height, &channels);
+        if (fields < 2 || width <= 0 || height <= 0 || (channels != 1 && channels != 3)) {
+                cerr << "Raw format must be <width>x<height> or <width>x<height>x<1|3>" << endl;
+                return nullptr;
+        }
+        unique_ptr<RawSource> source(new RawSource());
+        if (!source->open(location, width, height, channels)) {
+                cerr << "Cannot open " << location << endl;
+                return nullptr;
+        }
+        return move(source);
+}
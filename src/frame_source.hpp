@@ -0,0 +1,28 @@
+#ifndef FRAME_SOURCE_HPP
+#define FRAME_SOURCE_HPP
+
+#include <memory>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+// consecutive failed reads a capture source tolerates before it ends
+const int CAPTURE_RETRY_LIMIT = 16;
+
+// A stream of decoded frames, read one at a time by a single thread.
+class FrameSource {
+public:
+        virtual ~FrameSource() {}
+
+        // false once the stream has ended; a frame that could not be read
+        // is returned as an empty Mat and the stream goes on
+        virtual bool read(cv::Mat &frame) = 0;
+};
+
+// Opens a video file or device through VideoCapture (a location made of
+// digits only is a device index), or, with a raw format "<w>x<h>" or
+// "<w>x<h>x<1|3>", a pipe or file of raw gray or BGR frames where "-" is
+// stdin. Null with a message on stderr when it cannot be opened.
+std::unique_ptr<FrameSource> openFrameSource(const std::string &location, const std::string &rawFormat);
+
+#endif
@@ -0,0 +1,18 @@
+#include <cmath>
+
+#include "hsv_tables.hpp"
+
+static HsvTables buildHsvTables() {
+        HsvTables tables;
+        tables.saturation[0] = tables.hue[0] = 0;
+        for (int i = 1; i < 256; i++) {
+                tables.saturation[i] = (int)lround((255 << HSV_SHIFT) / (1. * i));
+                tables.hue[i] = (int)lround((180 << HSV_SHIFT) / (6. * i));
+        }
+        return tables;
+}
+
+const HsvTables &hsvTables() {
+        static const HsvTables tables = buildHsvTables();
+        return tables;
+}
@@ -0,0 +1,51 @@
+#ifndef HSV_TABLES_HPP
+#define HSV_TABLES_HPP
+
+// OpenCV's fixed point conversion of 8-bit BGR pixels to HSV, one pixel
+// at a time. Kernels that only need a count or a histogram of some HSV
+// property use it to skip the full cvtColor() image while staying
+// bit-exact with it. Hue is in [0, 180], 180 included.
+
+const int HSV_SHIFT = 12;
+
+struct HsvTables {
+        // (255 << HSV_SHIFT) / v and (180 << HSV_SHIFT) / (6 * diff), rounded
+        int saturation[256];
+        int hue[256];
+};
+
+const HsvTables &hsvTables();
+
+inline int hsvSaturation(const HsvTables &tables, int v, int diff) {
+        return (diff * tables.saturation[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+}
+
+// Hue of a pixel depends on which channel is the largest (the branch),
+// the difference of the other two channels in hue order (g - b, b - r or
+// r - g) and diff = max - min channel.
+enum HsvBranch {
+        HSV_MAX_RED = 0,
+        HSV_MAX_GREEN = 1,
+        HSV_MAX_BLUE = 2
+};
+
+inline int hsvHue(const HsvTables &tables, int branch, int offset, int diff) {
+        int h = offset + 2 * branch * diff;
+        h = (h * tables.hue[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+        return h < 0 ? h + 180 : h;
+}
+
+inline int hsvBranch(int b, int g, int r, int v, int &offset) {
+        if (v == r) {
+                offset = g - b;
+                return HSV_MAX_RED;
+        }
+        if (v == g) {
+                offset = b - r;
+                return HSV_MAX_GREEN;
+        }
+        offset = r - g;
+        return HSV_MAX_BLUE;
+}
+
+#endif
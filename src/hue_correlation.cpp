@@ -0,0 +1,155 @@
+#include <cfloat>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "hue_correlation.hpp"
+#include "metrics.hpp"
+#include "scratch.hpp"
+
+using namespace std;
+
+// rows are padded to whole SSE registers, the padding stays zero
+const int ROW_ALIGNMENT = 4;
+
+// sum of squares below which a histogram counts as flat
+const double FLAT_SQUARES = 1e-6;
+
+// float dot products this close to the threshold are decided exactly; the
+// rounding of the float sweep stays far below it
+const double RECHECK_MARGIN = 1e-5;
+
+// compareHist(CV_COMP_CORREL) step for step, so it gives the same double
+static double correlation(const float *a, const float *b, int bins) {
+        double s1 = 0, s2 = 0, s11 = 0, s12 = 0, s22 = 0;
+        for (int i = 0; i < bins; i++) {
+                double x = a[i], y = b[i];
+                s12 += x * y;
+                s1 += x;
+                s11 += x * x;
+                s2 += y;
+                s22 += y * y;
+        }
+        double scale = 1. / bins;
+        double numerator = s12 - s1 * s2 * scale;
+        double denominator = (s11 - s1 * s1 * scale) * (s22 - s2 * s2 * scale);
+        return abs(denominator) > DBL_EPSILON ? numerator / sqrt(denominator) : 1.;
+}
+
+static inline float dot(const float *a, const float *b, int length) {
+#if defined(__SSE__)
+        __m128 sum0 = _mm_setzero_ps();
+        __m128 sum1 = _mm_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= length; i += 8) {
+                sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+                sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+        }
+        for (; i < length; i += 4) {
+                sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+        float sum = 0;
+        for (int i = 0; i < length; i++) {
+                sum += a[i] * b[i];
+        }
+        return sum;
+#endif
+}
+
+HueCorrelationIndex::HueCorrelationIndex(const float *histograms, size_t count, int bins)
+        : bins(bins),
+          stride((bins + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT),
+          rowCount(count),
+          rows(count * stride, 0.f),
+          histograms(histograms, histograms + count * bins) {
+        vector<double> centered(bins);
+        for (size_t r = 0; r < count; r++) {
+                double squares = center(histograms + r * bins, centered.data());
+                if (squares < FLAT_SQUARES) {
+                        // a NaN fails every comparison, so the sweep never
+                        // counts the row and it is scored exactly instead
+                        rows[r * stride] = NAN;
+                        flatRows.push_back(r);
+                        continue;
+                }
+
+                double scale = 1.0 / sqrt(squares);
+                float *row = &rows[r * stride];
+                for (int i = 0; i < bins; i++) {
+                        row[i] = (float)(centered[i] * scale);
+                }
+        }
+}
+
+double HueCorrelationIndex::center(const float *values, double *centered) const {
+        double mean = 0;
+        for (int i = 0; i < bins; i++) {
+                mean += values[i];
+        }
+        mean /= bins;
+
+        double squares = 0;
+        for (int i = 0; i < bins; i++) {
+                centered[i] = values[i] - mean;
+                squares += centered[i] * centered[i];
+        }
+        return squares;
+}
+
+int HueCorrelationIndex::countMatches(const float *histogram, double minCorrel, int stopAt) const {
+        ND_TIMED_SCOPE("histogram_compare");
+        Scratch &scratch = Scratch::local();
+        vector<double> &centered = scratch.hueCentered;
+        centered.resize(bins);
+        double squares = center(histogram, centered.data());
+
+        int matches = 0;
+
+        if (squares < FLAT_SQUARES) {
+                // too flat for the unit vector form, score every row exactly
+                for (size_t r = 0; r < rowCount && matches < stopAt; r++) {
+                        if (correlation(histogram, &histograms[r * bins], bins) >= minCorrel) {
+                                matches++;
+                        }
+                }
+                return matches;
+        }
+
+        for (size_t f = 0; f < flatRows.size() && matches < stopAt; f++) {
+                if (correlation(histogram, &histograms[flatRows[f] * bins], bins) >= minCorrel) {
+                        matches++;
+                }
+        }
+
+        vector<float> &query = scratch.hueQuery;
+        query.assign(stride, 0.f);
+        double scale = 1.0 / sqrt(squares);
+        for (int i = 0; i < bins; i++) {
+                query[i] = (float)(centered[i] * scale);
+        }
+
+        // clearly above or below the threshold the float sweep decides,
+        // near it the pair is scored the way compareHist() scores it
+        float above = (float)(minCorrel + RECHECK_MARGIN);
+        float below = (float)(minCorrel - RECHECK_MARGIN);
+        const float *row = rows.data();
+        for (size_t r = 0; r < rowCount && matches < stopAt; r++, row += stride) {
+                float product = dot(query.data(), row, stride);
+                if (product >= above) {
+                        matches++;
+                } else if (product >= below) {
+                        ND_COUNT("correlation_rechecks", 1);
+                        if (correlation(histogram, &histograms[r * bins], bins) >= minCorrel) {
+                                matches++;
+                        }
+                }
+        }
+        return matches;
+}
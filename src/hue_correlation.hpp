@@ -0,0 +1,42 @@
+#ifndef HUE_CORRELATION_HPP
+#define HUE_CORRELATION_HPP
+
+#include <cstddef>
+#include <vector>
+
+// Training hue histograms centered and scaled to unit length once, stored
+// as rows of a padded float matrix. The CV_COMP_CORREL correlation of a
+// test histogram with every training one is then a single sweep of dot
+// products instead of one compareHist() call, with its mean and variance
+// passes, per pair. Sweep results within a small margin of the threshold
+// are scored again exactly as compareHist() scores them, so the counts
+// are the same as with compareHist().
+class HueCorrelationIndex {
+public:
+        // count histograms of the given number of bins, stored row after row
+        HueCorrelationIndex(const float *histograms, size_t count, int bins);
+
+        size_t size() const { return rowCount; }
+
+        // number of training histograms correlating with the given one at
+        // least minCorrel, the sweep stops as soon as stopAt is reached
+        int countMatches(const float *histogram, double minCorrel, int stopAt) const;
+
+private:
+        // centered copy of a histogram, returns its sum of squares
+        double center(const float *histogram, double *centered) const;
+
+        int bins;
+        int stride;
+        size_t rowCount;
+        std::vector<float> rows;
+
+        // the histograms as given, for exact scores
+        std::vector<float> histograms;
+
+        // histograms too flat for a stable unit vector; compareHist reports
+        // a correlation of 1 for them, so they are scored exactly instead
+        std::vector<size_t> flatRows;
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef HUE_HISTOGRAM_HPP
+#define HUE_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/core/core.hpp>
+
+#include "hsv_tables.hpp"
+
+// bin of every hue in [0, 180] the way calcHist() bins an 8-bit plane,
+// Bins for a hue outside [RangeLow, RangeHigh)
+template <int Bins, int RangeLow, int RangeHigh>
+struct HueBins {
+        unsigned char bin[181];
+
+        HueBins() {
+                double scale = (double)Bins / (RangeHigh - RangeLow);
+                double offset = -scale * RangeLow;
+                for (int h = 0; h <= 180; h++) {
+                        int index = (int)std::floor(h * scale + offset);
+                        bin[h] = index >= 0 && index < Bins ? index : Bins;
+                }
+        }
+};
+
+// Hue histogram of an 8-bit BGR image in a single pass, without the HSV
+// image or its hue plane: the Bins x 1 float histogram calcHist() gives
+// for the hue plane of cvtColor(CV_BGR2HSV) with Bins uniform bins over
+// [RangeLow, RangeHigh). The counts are the same, so the same normalize()
+// gives the same histogram bit for bit.
+template <int Bins, int RangeLow, int RangeHigh>
+void bgrHueHistogram(const cv::Mat &bgr, cv::Mat &histogram) {
+        static_assert(Bins > 0 && Bins < 255 && RangeLow < RangeHigh, "invalid hue histogram");
+        CV_Assert(bgr.type() == CV_8UC3);
+        static const HueBins<Bins, RangeLow, RangeHigh> bins;
+        const HsvTables &tables = hsvTables();
+
+        // four partial histograms, so neighbouring pixels of the same color
+        // don't wait on each other's increments; the last slot of each
+        // collects the hues out of range
+        int counts[4][Bins + 1] = {};
+        for (int y = 0; y < bgr.rows; y++) {
+                const unsigned char *pixel = bgr.ptr<unsigned char>(y);
+                for (int x = 0; x < bgr.cols; x++, pixel += 3) {
+                        int b = pixel[0], g = pixel[1], r = pixel[2];
+                        int v = std::max(b, std::max(g, r));
+                        int diff = v - std::min(b, std::min(g, r));
+                        int offset;
+                        int branch = hsvBranch(b, g, r, v, offset);
+                        counts[x & 3][bins.bin[hsvHue(tables, branch, offset, diff)]]++;
+                }
+        }
+
+        histogram.create(Bins, 1, CV_32F);
+        for (int i = 0; i < Bins; i++) {
+                histogram.at<float>(i) = (float)(counts[0][i] + counts[1][i] + counts[2][i] + counts[3][i]);
+        }
+}
+
+#endif
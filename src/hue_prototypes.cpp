@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#include <opencv2/core/core.hpp>
+
+#include "feature_cache.hpp"
+#include "hue_prototypes.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+using namespace cv;
+
+// sum of squares below which a histogram counts as flat, as in the sweep
+const double PROTOTYPE_FLAT_SQUARES = 1e-6;
+
+const int KMEANS_ITERATIONS = 100;
+const int KMEANS_ATTEMPTS = 3;
+
+// centered and scaled to unit length, false for a flat histogram
+static bool unitVector(const float *histogram, int bins, double *unit) {
+        double mean = 0;
+        for (int i = 0; i < bins; i++) {
+                mean += histogram[i];
+        }
+        mean /= bins;
+
+        double squares = 0;
+        for (int i = 0; i < bins; i++) {
+                unit[i] = histogram[i] - mean;
+                squares += unit[i] * unit[i];
+        }
+        if (squares < PROTOTYPE_FLAT_SQUARES) {
+                return false;
+        }
+        double scale = 1.0 / sqrt(squares);
+        for (int i = 0; i < bins; i++) {
+                unit[i] *= scale;
+        }
+        return true;
+}
+
+static double distance(const double *a, const double *b, int bins) {
+        double sum = 0;
+        for (int i = 0; i < bins; i++) {
+                double d = a[i] - b[i];
+                sum += d * d;
+        }
+        return sqrt(sum);
+}
+
+HuePrototypeIndex::HuePrototypeIndex(const float *histograms, size_t count, int bins, int clusters,
+                                     bool exactBoundaries, const vector<char> &saved)
+        : bins(bins), rowCount(count), exactBoundaries(exactBoundaries), restoredClustering(false),
+          labels(count, -1) {
+        vector<size_t> shaped;
+        vector<double> units;
+        vector<double> unit(bins);
+        for (size_t r = 0; r < count; r++) {
+                if (unitVector(histograms + r * bins, bins, unit.data())) {
+                        shaped.push_back(r);
+                        units.insert(units.end(), unit.begin(), unit.end());
+                        labels[r] = 0;
+                }
+        }
+
+        clusters = min<int>(clusters, shaped.size());
+        restoredClustering = !saved.empty() && restore(saved, clusters);
+        if (!restoredClustering && clusters > 0) {
+                Mat samples(shaped.size(), bins, CV_32F);
+                for (size_t i = 0; i < shaped.size(); i++) {
+                        for (int b = 0; b < bins; b++) {
+                                samples.at<float>(i, b) = (float)units[i * bins + b];
+                        }
+                }
+                Mat clusterLabels, centers;
+                kmeans(samples, clusters, clusterLabels,
+                       TermCriteria(TermCriteria::COUNT + TermCriteria::EPS, KMEANS_ITERATIONS, 1e-6),
+                       KMEANS_ATTEMPTS, KMEANS_PP_CENTERS, centers);
+
+                // the radius is measured against the centroid as stored, in double
+                centroids.assign(clusters * bins, 0.0);
+                radii.assign(clusters, 0.0);
+                for (int c = 0; c < clusters; c++) {
+                        for (int b = 0; b < bins; b++) {
+                                centroids[c * bins + b] = centers.at<float>(c, b);
+                        }
+                }
+                for (size_t i = 0; i < shaped.size(); i++) {
+                        int c = clusterLabels.at<int>(i);
+                        labels[shaped[i]] = c;
+                        radii[c] = max(radii[c], distance(&units[i * bins], &centroids[c * bins], bins));
+                }
+        }
+
+        vector<float> flatHistograms;
+        vector<vector<float> > memberHistograms(radii.size());
+        for (size_t r = 0; r < count; r++) {
+                const float *histogram = histograms + r * bins;
+                auto &target = labels[r] < 0 ? flatHistograms : memberHistograms[labels[r]];
+                target.insert(target.end(), histogram, histogram + bins);
+        }
+        flat.reset(new HueCorrelationIndex(flatHistograms.data(), flatHistograms.size() / bins, bins));
+        for (size_t c = 0; c < memberHistograms.size(); c++) {
+                members.emplace_back(new HueCorrelationIndex(memberHistograms[c].data(),
+                                                             memberHistograms[c].size() / bins, bins));
+        }
+}
+
+// layout: bins and clusters as int32, the histogram count as uint64, one
+// int32 label per histogram, then the centroids and radii as doubles
+vector<char> HuePrototypeIndex::serialize() const {
+        int32_t shape[2] = {bins, (int32_t)radii.size()};
+        uint64_t count = rowCount;
+        vector<char> bytes((const char *)shape, (const char *)(shape + 2));
+        bytes.insert(bytes.end(), (const char *)&count, (const char *)(&count + 1));
+        bytes.insert(bytes.end(), (const char *)labels.data(), (const char *)(labels.data() + labels.size()));
+        bytes.insert(bytes.end(), (const char *)centroids.data(), (const char *)(centroids.data() + centroids.size()));
+        bytes.insert(bytes.end(), (const char *)radii.data(), (const char *)(radii.data() + radii.size()));
+        return bytes;
+}
+
+// labels holds 0 for every shaped histogram and -1 for every flat one; a
+// saved clustering must agree on that split and on the sizes
+bool HuePrototypeIndex::restore(const vector<char> &saved, int clusters) {
+        int32_t shape[2];
+        uint64_t count;
+        size_t expected = sizeof(shape) + sizeof(count) + rowCount * sizeof(int32_t)
+                          + (size_t)max(clusters, 0) * (bins + 1) * sizeof(double);
+        if (saved.size() != expected) {
+                return false;
+        }
+        const char *data = saved.data();
+        memcpy(shape, data, sizeof(shape));
+        memcpy(&count, data + sizeof(shape), sizeof(count));
+        if (shape[0] != bins || shape[1] != clusters || count != rowCount) {
+                return false;
+        }
+
+        vector<int32_t> savedLabels(rowCount);
+        vector<double> savedCentroids(clusters * bins), savedRadii(clusters);
+        data += sizeof(shape) + sizeof(count);
+        memcpy(savedLabels.data(), data, savedLabels.size() * sizeof(int32_t));
+        data += savedLabels.size() * sizeof(int32_t);
+        memcpy(savedCentroids.data(), data, savedCentroids.size() * sizeof(double));
+        data += savedCentroids.size() * sizeof(double);
+        memcpy(savedRadii.data(), data, savedRadii.size() * sizeof(double));
+
+        for (size_t r = 0; r < rowCount; r++) {
+                bool flatRow = labels[r] < 0;
+                if (flatRow ? savedLabels[r] != -1 : (savedLabels[r] < 0 || savedLabels[r] >= clusters)) {
+                        return false;
+                }
+        }
+        for (double radius : savedRadii) {
+                if (!(radius >= 0 && radius <= 2)) {
+                        return false;
+                }
+        }
+
+        labels.swap(savedLabels);
+        centroids.swap(savedCentroids);
+        radii.swap(savedRadii);
+        return true;
+}
+
+uint64_t HuePrototypeIndex::cacheKey(const float *histograms, size_t count, int bins, int clusters) {
+        ostringstream parameters;
+        parameters << bins << ' ' << clusters << ' ' << KMEANS_ITERATIONS << ' ' << KMEANS_ATTEMPTS << ' '
+                   << PROTOTYPE_FLAT_SQUARES;
+        string text = parameters.str();
+        return hashBytes(histograms, count * bins * sizeof(float), hashBytes(text.data(), text.size()));
+}
+
+int HuePrototypeIndex::countMatches(const float *histogram, double minCorrel, int stopAt) const {
+        int matches = flat->size() ? flat->countMatches(histogram, minCorrel, stopAt) : 0;
+
+        vector<double> query(bins);
+        if (!unitVector(histogram, bins, query.data())) {
+                // a flat query has no unit vector to bound, score every row
+                for (size_t c = 0; c < members.size() && matches < stopAt; c++) {
+                        matches += members[c]->countMatches(histogram, minCorrel, stopAt - matches);
+                }
+                return min(matches, stopAt);
+        }
+
+        ND_TIMED_SCOPE("histogram_compare");
+        double reach = sqrt(2.0 * max(0.0, 1.0 - minCorrel));
+        for (size_t c = 0; c < members.size() && matches < stopAt; c++) {
+                double d = distance(query.data(), &centroids[c * bins], bins);
+                if (d + radii[c] <= reach - PROTOTYPE_BOUND_MARGIN) {
+                        matches += members[c]->size();
+                } else if (d - radii[c] > reach + PROTOTYPE_BOUND_MARGIN) {
+                        continue;
+                } else if (exactBoundaries) {
+                        ND_COUNT("prototype_exact_scans", 1);
+                        matches += members[c]->countMatches(histogram, minCorrel, stopAt - matches);
+                } else if (d <= reach) {
+                        matches += members[c]->size();
+                }
+        }
+        return min(matches, stopAt);
+}
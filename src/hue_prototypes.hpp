@@ -0,0 +1,63 @@
+#ifndef HUE_PROTOTYPES_HPP
+#define HUE_PROTOTYPES_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "hue_correlation.hpp"
+
+// slack on the cluster bounds covering the float rounding of the sweep
+const double PROTOTYPE_BOUND_MARGIN = 1e-4;
+
+// Training hue histograms grouped by k-means into prototypes. On the unit
+// vectors HueCorrelationIndex compares, a correlation of at least c is a
+// distance of at most sqrt(2 (1 - c)), so with each centroid's radius
+// (the distance to its farthest member) the triangle inequality settles
+// most clusters from one distance: every member matches, or none does.
+// Only clusters straddling the threshold are scanned member by member,
+// which gives the same counts as HueCorrelationIndex; without that exact
+// fallback a straddling cluster counts as a whole when its centroid is
+// close enough. Histograms too flat to normalize are kept aside and
+// always scored exactly. The clustering can be saved with serialize() and
+// handed back instead of running k-means again.
+class HuePrototypeIndex {
+public:
+        // saved is a serialize() result for the same histograms and cluster
+        // count, ignored when it does not fit them
+        HuePrototypeIndex(const float *histograms, size_t count, int bins, int clusters, bool exactBoundaries,
+                          const std::vector<char> &saved = std::vector<char>());
+
+        size_t size() const { return rowCount; }
+        size_t clusters() const { return members.size(); }
+        // whether the clustering came from the saved one
+        bool restored() const { return restoredClustering; }
+
+        // cluster of every histogram, centroids and radii
+        std::vector<char> serialize() const;
+        // hash of everything the clustering depends on, to store it under
+        static uint64_t cacheKey(const float *histograms, size_t count, int bins, int clusters);
+
+        // as HueCorrelationIndex::countMatches()
+        int countMatches(const float *histogram, double minCorrel, int stopAt) const;
+
+private:
+        bool restore(const std::vector<char> &saved, int clusters);
+
+        int bins;
+        size_t rowCount;
+        bool exactBoundaries;
+        bool restoredClustering;
+
+        // cluster of every histogram, -1 for a flat one
+        std::vector<int32_t> labels;
+        // unit length centroids, row after row, and their radii
+        std::vector<double> centroids;
+        std::vector<double> radii;
+        // the training histograms of each cluster, for the exact scan
+        std::vector<std::unique_ptr<HueCorrelationIndex> > members;
+        std::unique_ptr<HueCorrelationIndex> flat;
+};
+
+#endif
@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "image_loader.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+using namespace cv;
+
+// descriptor and size of a non-empty regular file, -1 when it cannot be read
+static int openFile(const string &path, size_t &size) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                return -1;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+                close(fd);
+                return -1;
+        }
+        size = info.st_size;
+        return fd;
+}
+
+static bool readFully(int fd, unsigned char *data, size_t size) {
+        size_t offset = 0;
+        while (offset < size) {
+                ssize_t count = pread(fd, data + offset, size - offset, offset);
+                if (count < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (count <= 0) {
+                        return false;
+                }
+                offset += count;
+        }
+        return true;
+}
+
+unsigned char *ImageLoader::Buffer::reserve(size_t size) {
+        if (capacity < size) {
+                data.reset(new unsigned char[size]);
+                capacity = size;
+        }
+        return data.get();
+}
+
+ImageLoader::ImageLoader(const vector<string> &fileNames, int readAhead) {
+        auto list = make_shared<vector<string> >(fileNames);
+        auto cursor = make_shared<size_t>(0);
+        names = [list, cursor](string &path) {
+                if (*cursor == list->size()) {
+                        return false;
+                }
+                path = (*list)[(*cursor)++];
+                return true;
+        };
+        start(readAhead);
+}
+
+ImageLoader::ImageLoader(NameSource names, int readAhead) : names(names) {
+        start(readAhead);
+}
+
+ImageLoader::~ImageLoader() {
+        {
+                lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+                bufferFree.notify_all();
+        }
+        for (auto &reader : readers) {
+                reader.join();
+        }
+}
+
+void ImageLoader::start(int readAhead) {
+        buffers.resize(max(1, readAhead));
+        for (size_t i = 0; i < buffers.size(); i++) {
+                freeBuffers.push_back(i);
+        }
+
+#ifdef HAVE_LIBURING
+        // one thread keeps every buffer's read in flight, when the kernel
+        // lets it set up a ring
+        io_uring probe;
+        if (io_uring_queue_init(buffers.size(), &probe, 0) == 0) {
+                io_uring_queue_exit(&probe);
+                readers.emplace_back([this] {
+                        readerLoopUring();
+                });
+                return;
+        }
+#endif
+        for (int i = 0; i < LOADER_READERS; i++) {
+                readers.emplace_back([this] {
+                        readerLoop();
+                });
+        }
+}
+
+bool ImageLoader::next(LoadedFile &file) {
+        ND_TIMED_SCOPE("io_wait");
+        unique_lock<std::mutex> lock(mutex);
+        fileReady.wait(lock, [this] {
+                return ready.count(handedOut) || (listed && handedOut >= total);
+        });
+        auto found = ready.find(handedOut);
+        if (found == ready.end()) {
+                return false;
+        }
+        file = found->second;
+        ready.erase(found);
+        handedOut++;
+        return true;
+}
+
+void ImageLoader::release(LoadedFile &file) {
+        if (file.buffer < 0) {
+                return;
+        }
+        file.bytes.release();
+        giveBack(file.buffer);
+        file.buffer = -1;
+}
+
+bool ImageLoader::takeBuffer(int &buffer, bool wait) {
+        unique_lock<std::mutex> lock(mutex);
+        if (wait) {
+                bufferFree.wait(lock, [this] { return stopping || !freeBuffers.empty(); });
+        }
+        if (stopping || freeBuffers.empty()) {
+                return false;
+        }
+        buffer = freeBuffers.back();
+        freeBuffers.pop_back();
+        return true;
+}
+
+void ImageLoader::giveBack(int buffer) {
+        lock_guard<std::mutex> lock(mutex);
+        freeBuffers.push_back(buffer);
+        bufferFree.notify_one();
+}
+
+// names are claimed with a buffer already in hand, so every claimed file
+// is read and next() never waits on a file that cannot get a buffer
+bool ImageLoader::claim(size_t &index, string &path) {
+        lock_guard<std::mutex> claimLock(claimMutex);
+        if (exhausted) {
+                return false;
+        }
+        if (!names(path)) {
+                exhausted = true;
+                lock_guard<std::mutex> lock(mutex);
+                listed = true;
+                total = claimed;
+                fileReady.notify_all();
+                return false;
+        }
+        index = claimed++;
+        return true;
+}
+
+void ImageLoader::publish(size_t index, const string &path, int buffer, long size) {
+        LoadedFile file;
+        file.index = index;
+        file.path = path;
+        file.buffer = buffer;
+        if (size > 0) {
+                file.bytes = Mat(1, (int)size, CV_8U, buffers[buffer].data.get());
+                ND_COUNT("loaded_bytes", size);
+        }
+
+        lock_guard<std::mutex> lock(mutex);
+        ready[index] = file;
+        fileReady.notify_all();
+}
+
+bool ImageLoader::stopRequested() {
+        lock_guard<std::mutex> lock(mutex);
+        return stopping;
+}
+
+void ImageLoader::readerLoop() {
+        int buffer;
+        while (takeBuffer(buffer, true)) {
+                size_t index;
+                string path;
+                if (!claim(index, path)) {
+                        giveBack(buffer);
+                        return;
+                }
+
+                ND_TIMED_SCOPE("read");
+                size_t size;
+                int fd = openFile(path, size);
+                bool read = false;
+                if (fd >= 0) {
+                        // the kernel reads the whole file ahead of the reads below
+                        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+                        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                        read = readFully(fd, buffers[buffer].reserve(size), size);
+                        close(fd);
+                }
+                publish(index, path, buffer, read ? (long)size : -1);
+        }
+}
+
+#ifdef HAVE_LIBURING
+struct PendingRead {
+        size_t index;
+        string path;
+        int fd;
+        size_t size;
+        size_t offset;
+};
+
+static void submitRead(io_uring &ring, int buffer, unsigned char *data, const PendingRead &read) {
+        // the ring has an entry per buffer, so one is always free
+        io_uring_sqe *entry = io_uring_get_sqe(&ring);
+        io_uring_prep_read(entry, read.fd, data + read.offset, read.size - read.offset, read.offset);
+        io_uring_sqe_set_data(entry, (void *)(intptr_t)buffer);
+}
+
+void ImageLoader::readerLoopUring() {
+        io_uring ring;
+        if (io_uring_queue_init(buffers.size(), &ring, 0) < 0) {
+                readerLoop();
+                return;
+        }
+
+        vector<PendingRead> pending(buffers.size());
+        int inFlight = 0;
+        bool more = true;
+        while (more || inFlight > 0) {
+                // a read goes out for every free buffer; with none in flight
+                // the loop waits for a consumer to release one
+                int buffer;
+                while (more && takeBuffer(buffer, inFlight == 0)) {
+                        PendingRead &read = pending[buffer];
+                        if (!claim(read.index, read.path)) {
+                                giveBack(buffer);
+                                more = false;
+                                break;
+                        }
+                        read.fd = openFile(read.path, read.size);
+                        if (read.fd < 0) {
+                                publish(read.index, read.path, buffer, -1);
+                                continue;
+                        }
+                        read.offset = 0;
+                        submitRead(ring, buffer, buffers[buffer].reserve(read.size), read);
+                        inFlight++;
+                }
+                if (stopRequested()) {
+                        more = false;
+                }
+                if (inFlight == 0) {
+                        continue;
+                }
+
+                io_uring_submit(&ring);
+                io_uring_cqe *completion;
+                if (io_uring_wait_cqe(&ring, &completion) < 0) {
+                        continue;
+                }
+                int done = (int)(intptr_t)io_uring_cqe_get_data(completion);
+                int result = completion->res;
+                io_uring_cqe_seen(&ring, completion);
+
+                PendingRead &read = pending[done];
+                if (result > 0) {
+                        read.offset += result;
+                        if (read.offset < read.size) {
+                                // a short read, the rest goes out again
+                                submitRead(ring, done, buffers[done].data.get(), read);
+                                continue;
+                        }
+                }
+                close(read.fd);
+                inFlight--;
+                publish(read.index, read.path, done, read.offset == read.size ? (long)read.size : -1);
+        }
+        io_uring_queue_exit(&ring);
+}
+#endif
@@ -0,0 +1,99 @@
+#ifndef IMAGE_LOADER_HPP
+#define IMAGE_LOADER_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+// files read ahead of the ones being decoded, buffers held by consumers
+// included
+const int LOADER_READ_AHEAD = 8;
+
+// reader threads when io_uring is not available
+const int LOADER_READERS = 4;
+
+// one whole file as read by the loader
+struct LoadedFile {
+        // position of the file in the order it was listed
+        size_t index = 0;
+        std::string path;
+        // header over one of the loader's buffers, no copy; empty when the
+        // file could not be read. Valid until release().
+        cv::Mat bytes;
+        int buffer = -1;
+};
+
+// Reads encoded images ahead of their decoding, so a slow or cold disk
+// keeps reading while the CPU decodes and analyzes the previous files.
+// Files are read in list order into a fixed set of reusable buffers,
+// through io_uring when it was built in and the kernel has it, otherwise
+// by reader threads with sequential read-ahead hints. next() hands them
+// out in the same order and may be called from several threads; each
+// file is given back with release() once decoded, which frees its buffer
+// for the next read. Time spent waiting in next() is the io_wait metric,
+// against the decode metric of the consumers.
+class ImageLoader {
+public:
+        // sets the next name and returns true, false once there are none
+        typedef std::function<bool(std::string &)> NameSource;
+
+        explicit ImageLoader(const std::vector<std::string> &fileNames, int readAhead = LOADER_READ_AHEAD);
+        // names are taken as they are needed, e.g. while a directory is listed
+        explicit ImageLoader(NameSource names, int readAhead = LOADER_READ_AHEAD);
+        ~ImageLoader();
+
+        // blocks for the next file, false once every file was handed out
+        bool next(LoadedFile &file);
+        void release(LoadedFile &file);
+
+private:
+        ImageLoader(const ImageLoader &) = delete;
+        ImageLoader &operator=(const ImageLoader &) = delete;
+
+        struct Buffer {
+                std::unique_ptr<unsigned char[]> data;
+                size_t capacity = 0;
+
+                unsigned char *reserve(size_t size);
+        };
+
+        void start(int readAhead);
+        bool takeBuffer(int &buffer, bool wait);
+        void giveBack(int buffer);
+        bool claim(size_t &index, std::string &path);
+        // size < 0 marks a file that could not be read
+        void publish(size_t index, const std::string &path, int buffer, long size);
+
+        bool stopRequested();
+
+        void readerLoop();
+        void readerLoopUring();
+
+        NameSource names;
+        std::mutex claimMutex;
+        size_t claimed = 0;
+        bool exhausted = false;
+
+        std::mutex mutex;
+        std::condition_variable bufferFree;
+        std::condition_variable fileReady;
+        std::vector<Buffer> buffers;
+        std::vector<int> freeBuffers;
+        std::map<size_t, LoadedFile> ready;
+        size_t handedOut = 0;
+        size_t total = 0;
+        bool listed = false;
+        bool stopping = false;
+
+        std::vector<std::thread> readers;
+};
+
+#endif
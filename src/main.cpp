@@ -1,11 +1,396 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
-#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "bounded_queue.hpp"
+#include "detectors.hpp"
+#include "frame.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "thread_pool.hpp"
 
 using namespace cv;
 using namespace std;
 
-int main() {
-    printf("Empty main()\n");
+// Resident novelty detection service. The training side of the chosen
+// detectors is prepared once, then requests are read from stdin or from
+// clients of a local Unix socket. A request is either a line holding an
+// image path or a line "@<n>" followed by n bytes of an encoded image.
+// Each image is decoded once and shown to every detector; requests are
+// answered, in order, with "<name>\t<verdict>...\t<latency ms>", one
+// verdict per detector.
+
+typedef chrono::steady_clock Clock;
+
+// requests waiting for a batch before the readers are paused
+const int REQUEST_QUEUE_DEPTH = 256;
+
+// largest encoded image accepted in an "@<n>" request
+const size_t MAX_REQUEST_BYTES = 256 * 1024 * 1024;
+
+// writes responses back to the stream a request came from
+class ResponseSink {
+public:
+    ResponseSink(int fd, bool owned) : fd(fd), owned(owned) {}
+    ~ResponseSink() {
+        if (owned) {
+            close(fd);
+        }
+    }
+
+    void write(const string &line) {
+        lock_guard<mutex> lock(writeMutex);
+        size_t written = 0;
+        while (written < line.size()) {
+            auto count = ::write(fd, line.data() + written, line.size() - written);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count <= 0) {
+                return;
+            }
+            written += count;
+        }
+    }
+
+private:
+    int fd;
+    bool owned;
+    mutex writeMutex;
+};
+
+struct Request {
+    string name;
+    Mat encoded;
+    Clock::time_point received;
+    shared_ptr<ResponseSink> sink;
+};
+
+// buffered line and block reads from a file descriptor
+class FdReader {
+public:
+    explicit FdReader(int fd) : fd(fd) {}
+
+    bool readLine(string &line) {
+        line.clear();
+        while (true) {
+            auto newline = find(buffer.begin() + position, buffer.end(), '\n');
+            line.append(buffer.begin() + position, newline);
+            if (newline != buffer.end()) {
+                position = newline - buffer.begin() + 1;
+                return true;
+            }
+            position = buffer.size();
+            if (!fill()) {
+                return !line.empty();
+            }
+        }
+    }
+
+    bool readBytes(size_t count, Mat &bytes) {
+        bytes.create(1, count, CV_8U);
+        size_t copied = 0;
+        while (copied < count) {
+            if (position == buffer.size() && !fill()) {
+                return false;
+            }
+            size_t chunk = min(count - copied, buffer.size() - position);
+            memcpy(bytes.ptr() + copied, buffer.data() + position, chunk);
+            position += chunk;
+            copied += chunk;
+        }
+        return true;
+    }
+
+private:
+    bool fill() {
+        buffer.resize(64 * 1024);
+        position = 0;
+        ssize_t count;
+        do {
+            count = read(fd, buffer.data(), buffer.size());
+        } while (count < 0 && errno == EINTR);
+        buffer.resize(max<ssize_t>(count, 0));
+        return count > 0;
+    }
+
+    int fd;
+    vector<char> buffer;
+    size_t position = 0;
+};
+
+static bool readFile(const string &path, Mat &bytes) {
+    ifstream file(path.c_str(), ios::binary | ios::ate);
+    if (!file.is_open()) {
+        return false;
+    }
+    size_t size = file.tellg();
+    file.seekg(0);
+    bytes.create(1, max<size_t>(size, 1), CV_8U);
+    return (bool)file.read((char *)bytes.ptr(), size);
+}
+
+// turns one input stream into requests until it ends
+static void readRequests(int fd, shared_ptr<ResponseSink> sink, BoundedQueue<Request> &queue) {
+    FdReader reader(fd);
+    string line;
+    unsigned rawCount = 0;
+
+    while (reader.readLine(line)) {
+        if (line.empty()) {
+            continue;
+        }
+
+        Request request;
+        request.sink = sink;
+
+        if (line[0] == '@') {
+            // a length that does not parse leaves the stream out of step,
+            // so the connection is dropped
+            char *end;
+            errno = 0;
+            unsigned long long length = strtoull(line.c_str() + 1, &end, 10);
+            if (errno != 0 || end == line.c_str() + 1 || *end != '\0' || length > MAX_REQUEST_BYTES) {
+                cerr << "Invalid request length: " << line << endl;
+                break;
+            }
+            if (!reader.readBytes(length, request.encoded)) {
+                break;
+            }
+            request.name = "#" + to_string(rawCount++);
+        } else {
+            request.name = line;
+            if (!readFile(line, request.encoded)) {
+                request.encoded = Mat();
+            }
+        }
+
+        request.received = Clock::now();
+        if (!queue.push(move(request))) {
+            break;
+        }
+    }
+}
+
+// set once SIGINT or SIGTERM asked the socket service to stop
+static atomic<bool> stopping(false);
+
+static void acceptConnections(int server, BoundedQueue<Request> &queue) {
+    while (true) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (!stopping) {
+                cerr << "accept failed: " << strerror(errno) << endl;
+            }
+            return;
+        }
+        auto sink = make_shared<ResponseSink>(client, true);
+        thread(readRequests, client, sink, ref(queue)).detach();
+    }
+}
+
+static int listenOn(const string &path) {
+    sockaddr_un address;
+    if (path.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path too long: " << path << endl;
+        return -1;
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+
+    // a socket left by an earlier run is replaced, anything else is kept
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            cerr << "Not a socket, refusing to replace: " << path << endl;
+            close(server);
+            return -1;
+        }
+        unlink(path.c_str());
+    }
+
+    if (server < 0 || bind(server, (sockaddr *)&address, sizeof(address)) != 0 || listen(server, 16) != 0) {
+        cerr << "Cannot listen on " << path << ": " << strerror(errno) << endl;
+        return -1;
+    }
+    return server;
+}
+
+static void printLatencySummary(vector<double> &latencies) {
+    if (latencies.empty()) {
+        return;
+    }
+    sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (auto latency : latencies) {
+        total += latency;
+    }
+    auto percentile = [&](double p) {
+        return latencies[min(latencies.size() - 1, (size_t)(p * latencies.size()))];
+    };
+    cerr << "Requests: " << latencies.size()
+         << "\tmean ms: " << total / latencies.size()
+         << "\tp50 ms: " << percentile(0.50)
+         << "\tp99 ms: " << percentile(0.99)
+         << "\tmax ms: " << latencies.back() << endl;
+}
+
+int main(int argc, char **argv) {
+    Options options(argc, argv);
+    if (!setupMetrics(options)) {
+        exit(-1);
+    }
+
+    string detectorNames = options.get("detector");
+    if (detectorNames == "all") {
+        detectorNames = "shape,surf,hue";
+    }
+
+    // comma separated detectors, all fed from the same decoded frame
+    vector<unique_ptr<Detector> > detectors;
+    int views = 0;
+    istringstream nameStream(detectorNames);
+    string detectorName;
+    while (getline(nameStream, detectorName, ',')) {
+        auto detector = createDetector(detectorName);
+        if (!detector) {
+            detectors.clear();
+            break;
+        }
+        views |= detector->views();
+        detectors.push_back(move(detector));
+    }
+
+    if (detectors.empty()) {
+        cerr << "Usage: nd --detector=<shape|surf|hue>[,...]|all [--training=<dir>] [--socket=<path>]"
+             << " [--batch=<n>] [--threads=<n>]" << endl;
+        exit(-1);
+    }
+
+    // a client hanging up before its answer must not end the service
+    signal(SIGPIPE, SIG_IGN);
+
+    // in socket mode SIGINT and SIGTERM are taken by one thread, which
+    // stops the service; blocked here so every later thread inherits it
+    string socketPath = options.get("socket");
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    if (!socketPath.empty()) {
+        pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+    }
+
+    ThreadPool pool(options.getInt("threads", 0));
+    size_t batchSize = max(1, options.getInt("batch", pool.size()));
+
+    for (auto &detector : detectors) {
+        if (!detector->prepare(options, pool)) {
+            exit(-1);
+        }
+    }
+    cerr << "Detectors " << detectorNames << " ready" << endl;
+
+    BoundedQueue<Request> queue(REQUEST_QUEUE_DEPTH);
+    thread input;
+    int server = -1;
+
+    if (socketPath.empty()) {
+        input = thread([&] {
+            readRequests(STDIN_FILENO, make_shared<ResponseSink>(STDOUT_FILENO, false), queue);
+            queue.close();
+        });
+    } else {
+        server = listenOn(socketPath);
+        if (server < 0) {
+            exit(-1);
+        }
+        input = thread(acceptConnections, server, ref(queue));
+
+        // wakes accept() and drains what was already queued
+        thread([&queue, server, stopSignals] {
+            int signalNumber;
+            sigwait(&stopSignals, &signalNumber);
+            stopping = true;
+            shutdown(server, SHUT_RDWR);
+            queue.close();
+        }).detach();
+    }
+
+    vector<double> latencies;
+    Request first;
+    while (queue.pop(first)) {
+        // whatever queued up while the last batch ran is classified together
+        vector<Request> batch;
+        batch.push_back(move(first));
+        Request next;
+        while (batch.size() < batchSize && queue.tryPop(next)) {
+            batch.push_back(move(next));
+        }
+
+        ND_COUNT("requests", batch.size());
+        vector<vector<int> > verdicts(batch.size(), vector<int>(detectors.size(), VERDICT_UNUSABLE));
+        pool.parallelFor(batch.size(), [&](size_t i) {
+            Frame frame;
+            if (batch[i].encoded.empty() || !frame.decode(batch[i].encoded, views)) {
+                return;
+            }
+            for (size_t d = 0; d < detectors.size(); d++) {
+                try {
+                    verdicts[i][d] = detectors[d]->classify(frame);
+                } catch (const cv::Exception &) {
+                    verdicts[i][d] = VERDICT_UNUSABLE;
+                }
+            }
+        });
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            double latency = chrono::duration<double, milli>(Clock::now() - batch[i].received).count();
+            latencies.push_back(latency);
+
+            ostringstream response;
+            response << batch[i].name;
+            for (auto verdict : verdicts[i]) {
+                response << "\t" << verdict;
+            }
+            response << "\t" << latency << "\n";
+            batch[i].sink->write(response.str());
+        }
+    }
+
+    input.join();
+    if (server >= 0) {
+        close(server);
+        unlink(socketPath.c_str());
+    }
+    printLatencySummary(latencies);
+    return 0;
 }
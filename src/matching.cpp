@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <sstream>
+
+#include <opencv2/features2d/features2d.hpp>
+
+#include "matching.hpp"
+#include "metrics.hpp"
+
+using namespace std;
+using namespace cv;
+
+// neighbours fetched per query descriptor by the global index, enough to
+// usually see the two nearest rows of every competitive training image
+const int GLOBAL_INDEX_KNN = 8;
+
+// LSH parameters for binary descriptors: tables, key bits, multi-probe level
+const int LSH_TABLES = 12;
+const int LSH_KEY_SIZE = 20;
+const int LSH_PROBE_LEVEL = 2;
+
+static inline int hammingDistance(const uchar *a, const uchar *b, int bytes) {
+        int distance = 0;
+        int i = 0;
+        for (; i + 8 <= bytes; i += 8) {
+                uint64_t wordA, wordB;
+                memcpy(&wordA, a + i, 8);
+                memcpy(&wordB, b + i, 8);
+                distance += __builtin_popcountll(wordA ^ wordB);
+        }
+        for (; i < bytes; i++) {
+                distance += __builtin_popcount(a[i] ^ b[i]);
+        }
+        return distance;
+}
+
+int countGoodMatchesHamming(const Mat &query, const Mat &train, double distCoeff) {
+        CV_Assert(query.empty() || train.empty() || (query.type() == CV_8U && train.type() == CV_8U && query.cols == train.cols));
+
+        int goodMatches = 0;
+        if (train.rows < 2) {
+                return goodMatches;
+        }
+
+        for (int i = 0; i < query.rows; i++) {
+                const uchar *queryRow = query.ptr<uchar>(i);
+                int best = INT_MAX, second = INT_MAX;
+                for (int j = 0; j < train.rows; j++) {
+                        int distance = hammingDistance(queryRow, train.ptr<uchar>(j), query.cols);
+                        if (distance < best) {
+                                second = best;
+                                best = distance;
+                        } else if (distance < second) {
+                                second = distance;
+                        }
+                }
+                if (best <= distCoeff * second) {
+                        goodMatches++;
+                }
+        }
+        ND_COUNT("good_matches", goodMatches);
+        return goodMatches;
+}
+
+Ptr<flann::IndexParams> FlannConfig::indexParams() const {
+        if (algorithm == FLANN_KMEANS) {
+                return new flann::KMeansIndexParams(branching, iterations);
+        }
+        return new flann::KDTreeIndexParams(trees);
+}
+
+Ptr<flann::SearchParams> FlannConfig::searchParams() const {
+        return new flann::SearchParams(checks);
+}
+
+string FlannConfig::describe() const {
+        ostringstream text;
+        if (algorithm == FLANN_KMEANS) {
+                text << "kmeans branching=" << branching << " iterations=" << iterations;
+        } else {
+                text << "kdtree trees=" << trees;
+        }
+        text << " checks=" << checks;
+        return text.str();
+}
+
+// section layout: algorithm, trees, branching, iterations, checks as int32
+vector<char> FlannConfig::serialize() const {
+        int32_t fields[5] = {algorithm, trees, branching, iterations, checks};
+        return vector<char>((const char *)fields, (const char *)(fields + 5));
+}
+
+bool FlannConfig::deserialize(const char *data, size_t length) {
+        int32_t fields[5];
+        if (length != sizeof(fields)) {
+                return false;
+        }
+        memcpy(fields, data, sizeof(fields));
+        if ((fields[0] != FLANN_KDTREE && fields[0] != FLANN_KMEANS) || fields[1] <= 0 || fields[2] <= 1
+            || fields[3] <= 0 || fields[4] <= 0) {
+                return false;
+        }
+        algorithm = fields[0];
+        trees = fields[1];
+        branching = fields[2];
+        iterations = fields[3];
+        checks = fields[4];
+        return true;
+}
+
+int countGoodMatches(const Mat &query, const Mat &train, double distCoeff, const FlannConfig &flannConfig) {
+        if (query.type() == CV_8U || train.type() == CV_8U) {
+                return countGoodMatchesHamming(query, train, distCoeff);
+        }
+
+        // match descriptor vectors using FLANN matcher
+        FlannBasedMatcher matcher(flannConfig.indexParams(), flannConfig.searchParams());
+        vector< vector<DMatch> > matches;
+        matcher.knnMatch(query, train, matches, 2);
+
+        int goodMatches = 0;
+        for (auto &match : matches) {
+                if (match.size() < 2) {
+                        continue;
+                }
+                if (match[0].distance <= distCoeff * match[1].distance) {
+                        goodMatches++;
+                }
+        }
+        ND_COUNT("good_matches", goodMatches);
+        return goodMatches;
+}
+
+GlobalIndex::GlobalIndex(const DescriptorModel &model, const Mat &rows, const FlannConfig &flannConfig)
+        : descriptors(rows.empty() ? model.all() : rows), checks(flannConfig.checks) {
+        for (size_t i = 0; i < model.size(); i++) {
+                firstRows.push_back(model.firstRow(i));
+        }
+        for (size_t i = 0; i < firstRows.size(); i++) {
+                size_t end = i + 1 < firstRows.size() ? firstRows[i + 1] : (size_t)descriptors.rows;
+                rowCounts.push_back(end - firstRows[i]);
+        }
+
+        // same index and search defaults as FlannBasedMatcher, built
+        // directly over the mapped rows
+        if (descriptors.empty()) {
+                return;
+        }
+        if (descriptors.type() == CV_8U) {
+                index.build(descriptors, flann::LshIndexParams(LSH_TABLES, LSH_KEY_SIZE, LSH_PROBE_LEVEL),
+                            cvflann::FLANN_DIST_HAMMING);
+        } else {
+                index.build(descriptors, *flannConfig.indexParams());
+        }
+}
+
+int GlobalIndex::imageOfRow(int row) const {
+        // last image whose first row is not past the given one; images
+        // without descriptors share a first row with their successor
+        auto it = upper_bound(firstRows.begin(), firstRows.end(), (size_t)row);
+        return (int)(it - firstRows.begin()) - 1;
+}
+
+void GlobalIndex::nearestTwo(const Mat &query, int queryRow, int image, float &best, float &second) const {
+        best = second = FLT_MAX;
+        int first = firstRows[image];
+        for (int r = first; r < first + (int)rowCounts[image]; r++) {
+                float distance;
+                if (descriptors.type() == CV_8U) {
+                        distance = hammingDistance(query.ptr<uchar>(queryRow), descriptors.ptr<uchar>(r), query.cols);
+                } else {
+                        const float *a = query.ptr<float>(queryRow);
+                        const float *b = descriptors.ptr<float>(r);
+                        distance = 0;
+                        for (int c = 0; c < query.cols; c++) {
+                                distance += (a[c] - b[c]) * (a[c] - b[c]);
+                        }
+                }
+                if (distance < best) {
+                        second = best;
+                        best = distance;
+                } else if (distance < second) {
+                        second = distance;
+                }
+        }
+}
+
+void GlobalIndex::vote(const Mat &query, double distCoeff, vector<int> &matchesCount) const {
+        matchesCount.assign(firstRows.size(), 0);
+        if (query.empty() || descriptors.empty()) {
+                return;
+        }
+
+        int knn = min(GLOBAL_INDEX_KNN, descriptors.rows);
+        Mat indices, dists;
+        index.knnSearch(query, indices, dists, knn, flann::SearchParams(checks));
+        // the KD-tree index reports squared L2 distances, so the ratio is
+        // squared as well to match the sqrt'd distances of the per-pair
+        // matcher; Hamming distances come back as plain integers
+        double ratio = distCoeff * distCoeff;
+        if (dists.type() != CV_32F) {
+                dists.convertTo(dists, CV_32F);
+                ratio = distCoeff;
+        }
+
+        vector<int> images(knn);
+        int rescans = 0;
+        for (int i = 0; i < query.rows; i++) {
+                const int *rowIndices = indices.ptr<int>(i);
+                const float *rowDists = dists.ptr<float>(i);
+
+                int found = 0;
+                while (found < knn && rowIndices[found] >= 0) {
+                        images[found] = imageOfRow(rowIndices[found]);
+                        found++;
+                }
+
+                // the ratio test per image needs its two nearest rows; when the
+                // second fell outside the neighbour list, both are found by
+                // scanning that image's rows, and images of a single row get
+                // no matches, as with the per pair matcher
+                for (int j = 0; j < found; j++) {
+                        bool firstOfImage = find(images.begin(), images.begin() + j, images[j]) == images.begin() + j;
+                        if (!firstOfImage || rowCounts[images[j]] < 2) {
+                                continue;
+                        }
+
+                        auto second = find(images.begin() + j + 1, images.begin() + found, images[j]);
+                        float bestDist = rowDists[j], secondDist;
+                        if (second != images.begin() + found) {
+                                secondDist = rowDists[second - images.begin()];
+                        } else {
+                                nearestTwo(query, i, images[j], bestDist, secondDist);
+                                rescans++;
+                        }
+
+                        if (bestDist <= ratio * secondDist) {
+                                matchesCount[images[j]]++;
+                        }
+                }
+        }
+        ND_COUNT("global_index_rescans", rescans);
+        ND_COUNT("good_matches", accumulate(matchesCount.begin(), matchesCount.end(), 0));
+}
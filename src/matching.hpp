@@ -0,0 +1,82 @@
+#ifndef MATCHING_HPP
+#define MATCHING_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/flann/flann.hpp>
+
+#include "descriptor_model.hpp"
+
+// model section holding the FLANN configuration chosen by tuning
+const uint32_t MODEL_SECTION_FLANN = modelTag('F', 'L', 'N', 'N');
+
+enum FlannAlgorithm {
+        FLANN_KDTREE = 0,
+        FLANN_KMEANS = 1
+};
+
+// Index and search parameters of FLANN matching of float descriptors. The
+// defaults are those of a default constructed FlannBasedMatcher.
+struct FlannConfig {
+        int algorithm = FLANN_KDTREE;
+        // randomized KD-trees
+        int trees = 4;
+        // hierarchical k-means tree
+        int branching = 32;
+        int iterations = 11;
+        // leaves visited per query
+        int checks = 32;
+
+        cv::Ptr<cv::flann::IndexParams> indexParams() const;
+        cv::Ptr<cv::flann::SearchParams> searchParams() const;
+        std::string describe() const;
+
+        std::vector<char> serialize() const;
+        bool deserialize(const char *data, size_t length);
+};
+
+// number of query descriptors whose nearest train descriptor passes the
+// ratio test against the second nearest one; float descriptors go through
+// FLANN, binary ones through countGoodMatchesHamming()
+int countGoodMatches(const cv::Mat &query, const cv::Mat &train, double distCoeff,
+                     const FlannConfig &flannConfig = FlannConfig());
+
+// Exact two nearest neighbours of CV_8U bit string descriptors by Hamming
+// distance, 64 bits per popcount. For a few hundred descriptors per image
+// a brute force scan beats building any index.
+int countGoodMatchesHamming(const cv::Mat &query, const cv::Mat &train, double distCoeff);
+
+// One FLANN index over the stacked descriptors of every training image.
+// A single knn query per test image replaces the per image index builds;
+// neighbours are attributed to training images through the model's row
+// table and the ratio test is applied per image; an image whose second
+// nearest row is not among the neighbours has its rows scanned for that
+// query descriptor instead. Float descriptors are indexed by KD-trees,
+// binary ones by LSH over Hamming distance.
+class GlobalIndex {
+public:
+        // rows replaces the model's own rows when given, e.g. decoded ones
+        // of a compressed model, and must be stacked the same way
+        explicit GlobalIndex(const DescriptorModel &model, const cv::Mat &rows = cv::Mat(),
+                             const FlannConfig &flannConfig = FlannConfig());
+
+        // fills matchesCount with one good match count per training image
+        void vote(const cv::Mat &query, double distCoeff, std::vector<int> &matchesCount) const;
+
+private:
+        int imageOfRow(int row) const;
+        // two smallest distances, in the index's units, from a query row
+        // to the rows of one training image
+        void nearestTwo(const cv::Mat &query, int queryRow, int image, float &best, float &second) const;
+
+        std::vector<size_t> firstRows;
+        std::vector<size_t> rowCounts;
+        cv::Mat descriptors;
+        int checks;
+        // knnSearch is not const in the OpenCV API but only reads the index
+        mutable cv::flann::Index index;
+};
+
+#endif
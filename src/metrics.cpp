@@ -0,0 +1,169 @@
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <pthread.h>
+
+#include "metrics.hpp"
+#include "options.hpp"
+
+using namespace std;
+
+// metrics are never removed, so references handed out stay valid
+static mutex registryMutex;
+static map<string, unique_ptr<TimerMetric> > timers;
+static map<string, unique_ptr<CounterMetric> > counters;
+
+static string metricsPath;
+static MetricsFormat metricsFormat = METRICS_JSON;
+
+void TimerMetric::record(uint64_t elapsedNanoseconds) {
+        // bucket i holds latencies up to 2^i us
+        uint64_t micros = (elapsedNanoseconds + 999) / 1000;
+        int bucket = micros <= 1 ? 0 : 64 - __builtin_clzll(micros - 1);
+        bucket = min(bucket, METRIC_BUCKETS - 1);
+
+        count.fetch_add(1, memory_order_relaxed);
+        nanoseconds.fetch_add(elapsedNanoseconds, memory_order_relaxed);
+        buckets[bucket].fetch_add(1, memory_order_relaxed);
+}
+
+TimerMetric &timerMetric(const char *name) {
+        lock_guard<mutex> lock(registryMutex);
+        auto &metric = timers[name];
+        if (!metric) {
+                metric.reset(new TimerMetric());
+        }
+        return *metric;
+}
+
+CounterMetric &counterMetric(const char *name) {
+        lock_guard<mutex> lock(registryMutex);
+        auto &metric = counters[name];
+        if (!metric) {
+                metric.reset(new CounterMetric());
+        }
+        return *metric;
+}
+
+static double bucketBound(int bucket) {
+        return (double)(1ull << bucket) / 1e6;
+}
+
+static void dumpJson(ostream &out) {
+        out << "{\"timers\": {";
+        const char *separator = "";
+        for (auto &entry : timers) {
+                const TimerMetric &metric = *entry.second;
+                out << separator << "\n  \"" << entry.first << "\": {\"count\": " << metric.count.load()
+                    << ", \"seconds\": " << metric.nanoseconds.load() / 1e9 << ", \"buckets\": [";
+                for (int i = 0; i < METRIC_BUCKETS; i++) {
+                        out << (i ? ", " : "") << "{\"le\": ";
+                        if (i == METRIC_BUCKETS - 1) {
+                                out << "\"+Inf\"";
+                        } else {
+                                out << bucketBound(i);
+                        }
+                        out << ", \"count\": " << metric.buckets[i].load() << "}";
+                }
+                out << "]}";
+                separator = ",";
+        }
+        out << "\n}, \"counters\": {";
+        separator = "";
+        for (auto &entry : counters) {
+                out << separator << "\n  \"" << entry.first << "\": " << entry.second->value.load();
+                separator = ",";
+        }
+        out << "\n}}\n";
+}
+
+static void dumpPrometheus(ostream &out) {
+        out << "# TYPE nd_stage_seconds histogram\n";
+        for (auto &entry : timers) {
+                const TimerMetric &metric = *entry.second;
+                string label = "stage=\"" + entry.first + "\"";
+                // prometheus buckets are cumulative
+                uint64_t cumulative = 0;
+                for (int i = 0; i < METRIC_BUCKETS; i++) {
+                        cumulative += metric.buckets[i].load();
+                        out << "nd_stage_seconds_bucket{" << label << ",le=\"";
+                        if (i == METRIC_BUCKETS - 1) {
+                                out << "+Inf";
+                        } else {
+                                out << bucketBound(i);
+                        }
+                        out << "\"} " << cumulative << "\n";
+                }
+                out << "nd_stage_seconds_sum{" << label << "} " << metric.nanoseconds.load() / 1e9 << "\n";
+                out << "nd_stage_seconds_count{" << label << "} " << metric.count.load() << "\n";
+        }
+        out << "# TYPE nd_events_total counter\n";
+        for (auto &entry : counters) {
+                out << "nd_events_total{event=\"" << entry.first << "\"} " << entry.second->value.load() << "\n";
+        }
+}
+
+void dumpMetrics(ostream &out, MetricsFormat format) {
+        lock_guard<mutex> lock(registryMutex);
+        if (format == METRICS_PROMETHEUS) {
+                dumpPrometheus(out);
+        } else {
+                dumpJson(out);
+        }
+}
+
+// written next to the target and renamed, readers never see half a dump
+static void writeMetricsFile() {
+        string temporary = metricsPath + ".tmp";
+        {
+                ofstream out(temporary.c_str());
+                dumpMetrics(out, metricsFormat);
+                if (!out) {
+                        return;
+                }
+        }
+        rename(temporary.c_str(), metricsPath.c_str());
+}
+
+bool setupMetrics(const Options &options) {
+        metricsPath = options.get("metrics");
+        if (metricsPath.empty()) {
+                return true;
+        }
+
+        string format = options.get("metrics-format", "json");
+        if (format == "prometheus") {
+                metricsFormat = METRICS_PROMETHEUS;
+        } else if (format != "json") {
+                cerr << "Unknown metrics format " << format << endl;
+                return false;
+        }
+
+#ifndef ND_METRICS
+        cerr << "Metrics are compiled out, " << metricsPath << " will be empty" << endl;
+#endif
+
+        // SIGUSR1 is blocked in every thread started from here on and
+        // taken synchronously by a thread of its own
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        thread([signals] {
+                int signal;
+                while (sigwait(&signals, &signal) == 0) {
+                        writeMetricsFile();
+                }
+        }).detach();
+
+        atexit(writeMetricsFile);
+        return true;
+}
@@ -0,0 +1,82 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+class Options;
+
+// Stage timers and event counters. A timer keeps a call count, the total
+// time and a latency histogram with power of two buckets from 1 us up,
+// the last bucket being unbounded. Everything is updated with relaxed
+// atomics, so the hot path never takes a lock; a metric is looked up by
+// name once per call site.
+//
+// The ND_TIMED_SCOPE and ND_COUNT macros are the only way the code
+// records anything. Without ND_METRICS defined they expand to nothing.
+
+const int METRIC_BUCKETS = 26;
+
+struct TimerMetric {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> nanoseconds{0};
+        std::atomic<uint64_t> buckets[METRIC_BUCKETS] = {};
+
+        void record(uint64_t elapsedNanoseconds);
+};
+
+struct CounterMetric {
+        std::atomic<uint64_t> value{0};
+};
+
+// the metric registered under a name, created on first use
+TimerMetric &timerMetric(const char *name);
+CounterMetric &counterMetric(const char *name);
+
+enum MetricsFormat {
+        METRICS_JSON,
+        METRICS_PROMETHEUS
+};
+
+void dumpMetrics(std::ostream &out, MetricsFormat format);
+
+// With --metrics=<path>, writes every metric to the file at exit and on
+// SIGUSR1, in the format given by --metrics-format=json|prometheus
+// (default json). Must be called before any other thread is started.
+bool setupMetrics(const Options &options);
+
+class ScopedTimer {
+public:
+        explicit ScopedTimer(TimerMetric &metric)
+                : metric(metric), start(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer() {
+                auto elapsed = std::chrono::steady_clock::now() - start;
+                metric.record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+
+private:
+        TimerMetric &metric;
+        std::chrono::steady_clock::time_point start;
+};
+
+#define ND_METRIC_CONCAT_(a, b) a##b
+#define ND_METRIC_CONCAT(a, b) ND_METRIC_CONCAT_(a, b)
+
+#ifdef ND_METRICS
+// times the rest of the enclosing scope
+#define ND_TIMED_SCOPE(name) \
+        static TimerMetric &ND_METRIC_CONCAT(ndTimer, __LINE__) = timerMetric(name); \
+        ScopedTimer ND_METRIC_CONCAT(ndScope, __LINE__)(ND_METRIC_CONCAT(ndTimer, __LINE__))
+#define ND_COUNT(name, amount) \
+        do { \
+                static CounterMetric &counter = counterMetric(name); \
+                counter.value.fetch_add(amount, std::memory_order_relaxed); \
+        } while (0)
+#else
+#define ND_TIMED_SCOPE(name) do {} while (0)
+#define ND_COUNT(name, amount) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <numeric>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "hue_correlation.hpp"
+#include "hue_histogram.hpp"
+#include "hue_prototypes.hpp"
+#include "image_loader.hpp"
+#include "metrics.hpp"
+#include "object_analysis.hpp"
+#include "scratch.hpp"
+
+using namespace std;
+using namespace cv;
+
+// the file is read once by the loader, hashed for the cache and decoded
+// from memory
+static void analyzeFile(const Mat &encoded, ObjectData &data, bool display, int features,
+                        const FeatureCache *cache) {
+        if (cache && cache->lookup(encoded, data)) {
+                return;
+        }
+        Frame frame;
+        frame.decode(encoded, OBJECT_ANALYSIS_VIEWS);
+        analyzeImage(frame, data, display, features);
+        if (cache) {
+                cache->store(encoded, data);
+        }
+}
+
+ObjectTable analyzeImages (const vector<string> &fileNames, ThreadPool *pool, int features,
+                           const FeatureCache *cache) {
+        ObjectTable dataBuffer;
+        dataBuffer.resize(fileNames.size());
+        dataBuffer.fileNames = fileNames;
+
+        // every worker holds one buffer while it decodes, the rest read ahead
+        ImageLoader loader(fileNames, LOADER_READ_AHEAD + (pool ? pool->size() : 1));
+
+        if (pool) {
+                // one pool item per image, so the pool balances uneven images
+                // by stealing as before; the loader only reads ahead, each
+                // item analyzes the next file it hands out and writes that
+                // file's own row, so results keep input order
+                pool->parallelFor(fileNames.size(), [&](size_t) {
+                        LoadedFile file;
+                        if (!loader.next(file)) {
+                                return;
+                        }
+                        ObjectData data;
+                        analyzeFile(file.bytes, data, false, features, cache);
+                        loader.release(file);
+                        dataBuffer.set(file.index, data);
+                });
+                return dataBuffer;
+        }
+
+        LoadedFile file;
+        while (loader.next(file)) {
+                ObjectData data;
+                analyzeFile(file.bytes, data, true, features, cache);
+                loader.release(file);
+                dataBuffer.set(file.index, data);
+
+                // waitKey(0);
+                // break;
+        }
+        return dataBuffer;
+}
+
+void analyzeImage(Frame &frame, ObjectData &data, bool display, int features) {
+        // every per-image buffer below lives in the worker's scratch
+        Scratch &scratch = Scratch::local();
+        const Mat &sourceGray = frame.gray();
+        Mat colorImage = frame.bgr();
+        Mat grayImage = scratch.gray.view(sourceGray.size(), CV_8U);
+        Mat contourImage = scratch.edges.view(sourceGray.size(), CV_8U);
+
+        data.flags = 0;
+
+        // get grayscale and contours
+        prepareImageMats(sourceGray, grayImage, contourImage);
+
+        // clean from distant noise
+        vector<Point> &contourPoints = scratch.contourPoints;
+        {
+                ND_TIMED_SCOPE("contours");
+                findNonZero(contourImage, contourPoints);
+                cleanContoursWithSigma(contourPoints, CONTOUR_MAX_SIGMA, scratch.pointDistances);
+        }
+        ND_COUNT("contour_points", contourPoints.size());
+
+        // limit image to the object
+        auto boundingBox = boundingRect(contourPoints);
+        colorImage = Mat(colorImage, boundingBox);
+        grayImage = Mat(grayImage, boundingBox);
+        contourImage = Mat(contourImage, boundingBox);
+
+        if (features & OBJECT_SHAPE_FEATURES) {
+                // calculate shape coefficients
+                vector<Point> &hull = scratch.hull;
+                convexHull(contourPoints, hull);
+                auto area = contourArea(hull);
+
+                Point2f circleCenter;
+                float circleRadius;
+                minEnclosingCircle(hull, circleCenter, circleRadius);
+                data.roundness = sqrt(area / (M_PI * pow(circleRadius, 2)));
+
+                // calculate contour moments
+
+                Moments mu = moments(contourPoints, true);
+                HuMoments(mu, data.hu);
+        } else {
+                data.roundness = 0;
+                fill(data.hu, data.hu + HU_MOMENTS, 0.0);
+        }
+
+        Mat hueImage;
+        if (features & OBJECT_HUE_FEATURES) {
+                // calculate hue histograms
+                ND_TIMED_SCOPE("histogram");
+                Mat &hueHist = scratch.hueHist;
+
+                // hue binned straight from BGR, no HSV image or hue plane
+                bgrHueHistogram<HUE_HIST_BINS, 0, 180>(colorImage, hueHist);
+                normalize(hueHist, hueHist, 0, 1, NORM_MINMAX, -1, Mat());
+                copy(hueHist.ptr<float>(), hueHist.ptr<float>() + HUE_HIST_BINS, data.hueHist);
+
+                // the hue plane itself is only needed for its window
+                if (display) {
+                        Mat hsvImage = scratch.hsv.view(boundingBox.size(), CV_8UC3);
+                        cvtColor(colorImage, hsvImage, CV_BGR2HSV);
+                        hueImage = scratch.hue.view(boundingBox.size(), CV_8U);
+                        int hueChannel[] = {0, 0};
+                        mixChannels(&hsvImage, 1, &hueImage, 1, hueChannel, 1);
+                }
+        } else {
+                fill(data.hueHist, data.hueHist + HUE_HIST_BINS, 0.0f);
+        }
+        scratch.checkpoint();
+
+        // debug print
+        if (display) {
+                imshow("COLOR", colorImage);
+                imshow("GRAY", grayImage);
+                imshow("CONTOUR", contourImage);
+                if (!hueImage.empty()) {
+                        imshow("HUE", hueImage);
+                }
+        }
+}
+
+void compareRoundness(const ObjectTable &training, ObjectTable &testing) {
+        // cout << "Roundness tests" << endl;
+        double minRoundness = *min_element(training.roundness.begin(), training.roundness.end());
+        unsigned passed = 0;
+        unsigned failed = 0;
+
+        // cout << "\tminimal roundness found in training: " << minRoundness << endl;
+        minRoundness *= 1.0 - ROUNDNESS_LIMIT_MARGIN;
+        // cout << "\troundness lower limit for pass: " << minRoundness << endl;
+
+        for (size_t i = 0; i < testing.size(); i++) {
+                if (testing.roundness[i] > minRoundness) {
+                        passed++;
+                        testing.flags[i] |= OBJECT_ROUNDNESS_PASS;
+                } else {
+                        failed++;
+                        testing.flags[i] &= ~OBJECT_ROUNDNESS_PASS;
+                }
+        }
+
+        // cout << "passed : " << passed << endl;
+        // cout << "failed : " << failed << endl;
+
+}
+
+void compareHueHistograms(const ObjectTable &training, ObjectTable &testing,
+                          int prototypes, bool exactBoundaries, const FeatureCache *cache) {
+        // cout << "Hue histogram tests" << endl;
+        int passed = 0;
+        int failed = 0;
+
+        // training histograms are normalized once, each test object is then
+        // scored against all of them in one sweep, or against the cluster
+        // prototypes first
+        unique_ptr<HueCorrelationIndex> hueIndex;
+        unique_ptr<HuePrototypeIndex> prototypeIndex;
+        if (prototypes > 0) {
+                uint64_t key = HuePrototypeIndex::cacheKey(training.hueHists.data(), training.size(),
+                                                           HUE_HIST_BINS, prototypes);
+                vector<char> saved;
+                if (cache) {
+                        cache->lookupTrainingSet(key, saved);
+                }
+                prototypeIndex.reset(new HuePrototypeIndex(training.hueHists.data(), training.size(),
+                                                           HUE_HIST_BINS, prototypes, exactBoundaries, saved));
+                if (cache && !prototypeIndex->restored()) {
+                        cache->storeTrainingSet(key, prototypeIndex->serialize());
+                }
+        } else {
+                hueIndex.reset(new HueCorrelationIndex(training.hueHists.data(), training.size(), HUE_HIST_BINS));
+        }
+
+        for (size_t i = 0; i < testing.size(); i++) {
+                int matches = prototypeIndex
+                              ? prototypeIndex->countMatches(testing.hueHist(i), HUE_HIST_MIN_CORREL, HUE_HIST_MIN_MATCHES)
+                              : hueIndex->countMatches(testing.hueHist(i), HUE_HIST_MIN_CORREL, HUE_HIST_MIN_MATCHES);
+                // cout << "File: " << testing.fileNames[i] << endl;
+                // cout << "\tMatches : " << matches << endl;
+
+                bool hueHistPass = matches >= HUE_HIST_MIN_MATCHES;
+                if (hueHistPass) {
+                        passed++;
+                        testing.flags[i] |= OBJECT_HUE_HIST_PASS;
+                } else {
+                        failed++;
+                        testing.flags[i] &= ~OBJECT_HUE_HIST_PASS;
+                }
+        }
+
+        // cout << "passed : " << passed << endl;
+        // cout << "failed : " << failed << endl;
+}
+
+void prepareImageMats(const Mat &sourceGray, Mat &grayImage, Mat &contourImage) {
+        ND_TIMED_SCOPE("preprocess");
+        static const Mat closingKernel = getStructuringElement(
+                MORPH_ELLIPSE, Size(CANNY_KERNEL_SIZE + 2, CANNY_KERNEL_SIZE + 2));
+        blur(sourceGray, grayImage, Size(BLUR_KERNEL_SIZE, BLUR_KERNEL_SIZE));
+        morphologyEx(grayImage, grayImage, MORPH_CLOSE, closingKernel);
+        Canny(grayImage, contourImage, LOW_THRESHOLD, LOW_THRESHOLD * THRESH_RATIO,
+              CANNY_KERNEL_SIZE);
+}
+
+void cleanContoursWithSigma(vector<Point> &points, double maxDistanceSigma) {
+        vector<double> pointDistances;
+        cleanContoursWithSigma(points, maxDistanceSigma, pointDistances);
+}
+
+void cleanContoursWithSigma(vector<Point> &points, double maxDistanceSigma, vector<double> &pointDistances) {
+
+        // calculate mean
+        auto sum = std::accumulate(points.begin(), points.end(), Point(0, 0));
+        Point mean(sum.x / points.size(), sum.y / points.size());
+
+        // calculate distances
+        pointDistances.resize(points.size());
+
+        transform(points.begin(), points.end(), pointDistances.begin(),
+                  [mean](Point &p) {
+                return norm(p - mean);
+        });
+
+        // calculate standard deviation
+        double stdDev =
+                sqrt(std::accumulate(pointDistances.begin(), pointDistances.end(), 0.0,
+                                     [](double x, double y) {
+                return x + y * y;
+        }) / pointDistances.size());
+
+        // cout << "sigma = " << stdDev << endl;
+
+        // clean
+        // cout << "points before: " << points.size() << endl;
+        points.erase(remove_if(points.begin(), points.end(),
+                               [maxDistanceSigma, stdDev, mean](Point &p) {
+                return (norm(p - mean) > maxDistanceSigma * stdDev);
+        }),
+                     points.end());
+        // cout << "points after: " << points.size() << endl;
+}
+
+float calculateScore(uint8_t flags) {
+        return WEIGHT_ROUNDNESS * (int)(bool)(flags & OBJECT_ROUNDNESS_PASS)
+               + WEIGHT_HUE_HIST * (int)(bool)(flags & OBJECT_HUE_HIST_PASS);
+}
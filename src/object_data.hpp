@@ -0,0 +1,66 @@
+#ifndef OBJECT_DATA_HPP
+#define OBJECT_DATA_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+const int HU_MOMENTS = 7;
+const int HUE_HIST_BINS = 23;
+
+enum ObjectFlags {
+        OBJECT_ROUNDNESS_PASS = 1 << 0,
+        OBJECT_HUE_HIST_PASS = 1 << 1
+};
+
+// fixed-size features of one analyzed object, no pixel data is kept
+struct ObjectData {
+        double hu[HU_MOMENTS];
+        double roundness;
+        float hueHist[HUE_HIST_BINS];
+        uint8_t flags;
+};
+
+// Features of a whole image set stored column by column. Each comparison
+// stage only streams the columns it reads, and hue histograms form one
+// contiguous row-major matrix.
+struct ObjectTable {
+        std::vector<std::string> fileNames;
+        std::vector<double> roundness;
+        std::vector<double> hu;
+        std::vector<float> hueHists;
+        std::vector<uint8_t> flags;
+
+        size_t size() const { return fileNames.size(); }
+
+        void resize(size_t count) {
+                fileNames.resize(count);
+                roundness.resize(count);
+                hu.resize(count * HU_MOMENTS);
+                hueHists.resize(count * HUE_HIST_BINS);
+                flags.resize(count);
+        }
+
+        const double *huMoments(size_t i) const { return &hu[i * HU_MOMENTS]; }
+        const float *hueHist(size_t i) const { return &hueHists[i * HUE_HIST_BINS]; }
+
+        void set(size_t i, const ObjectData &data) {
+                roundness[i] = data.roundness;
+                std::copy(data.hu, data.hu + HU_MOMENTS, &hu[i * HU_MOMENTS]);
+                std::copy(data.hueHist, data.hueHist + HUE_HIST_BINS, &hueHists[i * HUE_HIST_BINS]);
+                flags[i] = data.flags;
+        }
+
+        ObjectData get(size_t i) const {
+                ObjectData data;
+                data.roundness = roundness[i];
+                std::copy(huMoments(i), huMoments(i) + HU_MOMENTS, data.hu);
+                std::copy(hueHist(i), hueHist(i) + HUE_HIST_BINS, data.hueHist);
+                data.flags = flags[i];
+                return data;
+        }
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "options.hpp"
+
+using namespace std;
+
+Options::Options(int argc, char **argv) {
+        for (int i = 1; i < argc; i++) {
+                string arg = argv[i];
+                if (arg.compare(0, 2, "--") != 0 || arg.size() == 2) {
+                        positionalArgs.push_back(arg);
+                        continue;
+                }
+
+                auto separator = arg.find('=');
+                if (separator == string::npos) {
+                        values[arg.substr(2)] = "";
+                } else {
+                        values[arg.substr(2, separator - 2)] = arg.substr(separator + 1);
+                }
+        }
+}
+
+bool Options::has(const string &name) const {
+        return values.count(name) > 0;
+}
+
+string Options::get(const string &name, const string &fallback) const {
+        auto it = values.find(name);
+        return it == values.end() ? fallback : it->second;
+}
+
+int Options::getInt(const string &name, int fallback) const {
+        auto it = values.find(name);
+        if (it == values.end()) {
+                return fallback;
+        }
+        try {
+                return stoi(it->second);
+        } catch (const exception &) {
+                cerr << "Invalid value for --" << name << ": " << it->second << endl;
+                exit(-1);
+        }
+}
+
+double Options::getDouble(const string &name, double fallback) const {
+        auto it = values.find(name);
+        if (it == values.end()) {
+                return fallback;
+        }
+        try {
+                return stod(it->second);
+        } catch (const exception &) {
+                cerr << "Invalid value for --" << name << ": " << it->second << endl;
+                exit(-1);
+        }
+}
@@ -0,0 +1,25 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+// command line split into positional arguments and "--name" / "--name=value" options
+class Options {
+public:
+        Options(int argc, char **argv);
+
+        bool has(const std::string &name) const;
+        std::string get(const std::string &name, const std::string &fallback = "") const;
+        int getInt(const std::string &name, int fallback) const;
+        double getDouble(const std::string &name, double fallback) const;
+
+        const std::vector<std::string> &positional() const { return positionalArgs; }
+
+private:
+        std::vector<std::string> positionalArgs;
+        std::map<std::string, std::string> values;
+};
+
+#endif
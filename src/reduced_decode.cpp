@@ -0,0 +1,91 @@
+#include <csetjmp>
+#include <cstdio>
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#ifdef HAVE_JPEG
+#include <jpeglib.h>
+#endif
+
+#include "metrics.hpp"
+#include "reduced_decode.hpp"
+
+using namespace std;
+using namespace cv;
+
+#ifdef HAVE_JPEG
+// libjpeg's default handler exits the process, this one unwinds to the
+// decode call instead
+struct JpegError {
+        jpeg_error_mgr manager;
+        jmp_buf jump;
+};
+
+static void jpegErrorExit(j_common_ptr info) {
+        longjmp(((JpegError *)info->err)->jump, 1);
+}
+
+static bool decodeJpegReduced(FILE *file, int scale, Mat &image) {
+        jpeg_decompress_struct info;
+        JpegError error;
+        info.err = jpeg_std_error(&error.manager);
+        error.manager.error_exit = jpegErrorExit;
+        if (setjmp(error.jump)) {
+                jpeg_destroy_decompress(&info);
+                image.release();
+                return false;
+        }
+
+        jpeg_create_decompress(&info);
+        jpeg_stdio_src(&info, file);
+        jpeg_read_header(&info, TRUE);
+        info.scale_num = 1;
+        info.scale_denom = scale;
+        info.out_color_space = JCS_GRAYSCALE;
+        jpeg_start_decompress(&info);
+
+        image.create(info.output_height, info.output_width, CV_8UC1);
+        while (info.output_scanline < info.output_height) {
+                JSAMPROW row = image.ptr<uchar>(info.output_scanline);
+                jpeg_read_scanlines(&info, &row, 1);
+        }
+
+        jpeg_finish_decompress(&info);
+        jpeg_destroy_decompress(&info);
+        return true;
+}
+#endif
+
+// not a JPEG, or no libjpeg to scale with
+static Mat shrink(const Mat &fullImage, int scale) {
+        Mat image;
+        if (fullImage.empty() || scale == 1) {
+                return fullImage;
+        }
+        resize(fullImage, image, Size((fullImage.cols + scale - 1) / scale, (fullImage.rows + scale - 1) / scale),
+               0, 0, INTER_AREA);
+        return image;
+}
+
+Mat decodeReducedGray(const Mat &encodedImage, int scale) {
+        ND_TIMED_SCOPE("decode");
+        Mat image;
+        if (encodedImage.empty()) {
+                return image;
+        }
+
+#ifdef HAVE_JPEG
+        // a stream over the bytes in place, for the stdio source of libjpeg
+        FILE *file = fmemopen((void *)encodedImage.ptr(), encodedImage.total(), "rb");
+        if (file) {
+                bool decoded = decodeJpegReduced(file, scale, image);
+                fclose(file);
+                if (decoded) {
+                        return image;
+                }
+        }
+#endif
+
+        return shrink(imdecode(encodedImage, CV_LOAD_IMAGE_GRAYSCALE), scale);
+}
@@ -0,0 +1,13 @@
+#ifndef REDUCED_DECODE_HPP
+#define REDUCED_DECODE_HPP
+
+#include <opencv2/core/core.hpp>
+
+// Grayscale image at 1/scale of its size, scale being 1, 2, 4 or 8. JPEG
+// files are decoded by libjpeg's DCT scaling when it is available, so the
+// skipped resolution is never decoded; anything else is decoded in full
+// and shrunk. The reduced size is rounded up, like libjpeg does. Takes
+// the bytes of the encoded file, empty when they cannot be decoded.
+cv::Mat decodeReducedGray(const cv::Mat &encodedImage, int scale);
+
+#endif
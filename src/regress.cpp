@@ -0,0 +1,602 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "frame.hpp"
+#include "options.hpp"
+#include "shape_detector.hpp"
+#include "synthetic_images.hpp"
+
+using namespace std;
+using namespace cv;
+
+// Runs set1, set2 or set3 end to end over a generated data set, once in
+// its baseline configuration and once per faster mode that promises the
+// same verdicts. Each mode's verdicts must equal the baseline ones, its
+// best wall time of --repeat runs must stay within --max-slowdown of the
+// baseline's, and with --max-regression its images per second (training
+// and testing images) may drop at most by that fraction from the best
+// earlier run recorded in the results file. Every run is appended to the
+// results file, so throughput can be followed over time. The stream
+// suite checks set1's streaming mode frame by frame instead.
+
+typedef chrono::steady_clock Clock;
+
+// how a binary is run; the first mode of a suite is the baseline
+struct Mode {
+        string name;
+        vector<string> args;
+        // verdicts are read from this file in the run directory, from
+        // stdout when empty
+        string verdictFile;
+        // a file the run writes that must equal the baseline's byte for
+        // byte, none when empty
+        string artifact;
+        // a directory removed before every run, none when empty
+        string cleared;
+};
+
+struct Suite {
+        string binary;
+        // shapes of the training and testing images, no training set when empty
+        vector<int> trainingShapes;
+        vector<int> testingShapes;
+        vector<Mode> modes;
+};
+
+struct Run {
+        double seconds = 0;
+        long peakRssKb = 0;
+        map<string, int> verdicts;
+};
+
+// runs change into their own directory, so every path they get is absolute
+static string absolutePath(const string &path) {
+        if (!path.empty() && path[0] == '/') {
+                return path;
+        }
+        char directory[4096];
+        return getcwd(directory, sizeof(directory)) ? string(directory) + "/" + path : path;
+}
+
+static bool makeDirectory(const string &path) {
+        return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+// "<name>\t<verdict>" lines, anything else is ignored
+static map<string, int> readVerdicts(const string &path) {
+        map<string, int> verdicts;
+        ifstream file(path.c_str());
+        string line;
+        while (getline(file, line)) {
+                auto tab = line.find('\t');
+                if (tab == string::npos) {
+                        continue;
+                }
+                istringstream value(line.substr(tab + 1));
+                int verdict;
+                if (value >> verdict) {
+                        verdicts[line.substr(0, tab)] = verdict;
+                }
+        }
+        return verdicts;
+}
+
+// runs the binary in its own directory with stdout and stderr captured
+// there, stdin from input when given; false when it cannot be started or
+// does not exit with 0
+static bool runMode(const string &binary, const Mode &mode, const string &directory, Run &run,
+                    int input = -1) {
+        if (!makeDirectory(directory)) {
+                return false;
+        }
+        string stdoutPath = directory + "/stdout.txt";
+        string stderrPath = directory + "/stderr.txt";
+
+        vector<string> arguments{binary};
+        arguments.insert(arguments.end(), mode.args.begin(), mode.args.end());
+        vector<char *> argv;
+        for (auto &argument : arguments) {
+                argv.push_back(&argument[0]);
+        }
+        argv.push_back(nullptr);
+
+        auto start = Clock::now();
+        pid_t child = fork();
+        if (child < 0) {
+                return false;
+        }
+        if (child == 0) {
+                int out = open(stdoutPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                int err = open(stderrPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (out < 0 || err < 0 || chdir(directory.c_str()) != 0) {
+                        _exit(127);
+                }
+                if (input >= 0) {
+                        dup2(input, STDIN_FILENO);
+                }
+                dup2(out, STDOUT_FILENO);
+                dup2(err, STDERR_FILENO);
+                execv(binary.c_str(), argv.data());
+                _exit(127);
+        }
+
+        int status;
+        struct rusage usage;
+        if (wait4(child, &status, 0, &usage) < 0) {
+                return false;
+        }
+        run.seconds = chrono::duration<double>(Clock::now() - start).count();
+        // kilobytes on Linux
+        run.peakRssKb = usage.ru_maxrss;
+        run.verdicts = readVerdicts(directory + "/" + (mode.verdictFile.empty() ? "stdout.txt" : mode.verdictFile));
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+        return remove(path);
+}
+
+static void removeTree(const string &path) {
+        nftw(path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static bool sameBytes(const string &path, const string &otherPath) {
+        ifstream file(path.c_str(), ios::binary), other(otherPath.c_str(), ios::binary);
+        if (!file.is_open() || !other.is_open()) {
+                return false;
+        }
+        return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>())
+               == string(istreambuf_iterator<char>(other), istreambuf_iterator<char>());
+}
+
+// differences of a run's verdicts from the baseline's, a few of them listed
+static int verdictDrift(const map<string, int> &baseline, const map<string, int> &verdicts, string &examples) {
+        int drift = 0;
+        ostringstream listed;
+        auto note = [&](const string &name, const string &what) {
+                if (drift++ < 5) {
+                        listed << " " << name << what;
+                }
+        };
+        for (auto &verdict : baseline) {
+                auto other = verdicts.find(verdict.first);
+                if (other == verdicts.end()) {
+                        note(verdict.first, " missing");
+                } else if (other->second != verdict.second) {
+                        note(verdict.first, " " + to_string(verdict.second) + "->" + to_string(other->second));
+                }
+        }
+        for (auto &verdict : verdicts) {
+                if (!baseline.count(verdict.first)) {
+                        note(verdict.first, " extra");
+                }
+        }
+        examples = listed.str();
+        return drift;
+}
+
+// best images per second recorded for each "<suite>\t<mode>" in earlier runs
+static map<string, double> bestRates(const string &resultsPath) {
+        map<string, double> best;
+        ifstream file(resultsPath.c_str());
+        string line;
+        while (getline(file, line)) {
+                istringstream fields(line);
+                string time, suite, mode, verdicts;
+                int images;
+                double seconds, rate;
+                long rss;
+                if (fields >> time >> suite >> mode >> images >> seconds >> rate >> rss >> verdicts) {
+                        double &entry = best[suite + "\t" + mode];
+                        entry = max(entry, rate);
+                }
+        }
+        return best;
+}
+
+static map<string, Suite> suites(const string &bin, const string &data, const string &work) {
+        string training = data + "/training";
+        string testing = data + "/testing";
+        map<string, Suite> all;
+
+        // reduced resolution decoding falls back to full resolution for
+        // ambiguous images, so it keeps the verdicts
+        Suite set1;
+        set1.binary = bin + "/set1";
+        set1.testingShapes = {SYNTHETIC_TRIANGLE, SYNTHETIC_QUAD, SYNTHETIC_ROUND};
+        set1.modes.push_back({"baseline", {testing}, ""});
+        set1.modes.push_back({"scale2", {testing, "--scale=2"}, ""});
+        set1.modes.push_back({"scale4", {testing, "--scale=4"}, ""});
+        all["set1"] = set1;
+
+        // --verbose evaluates every training image, the cascade stops at the
+        // first deciding gate; parallel training writes the same model, byte
+        // for byte. Every mode trains, so every mode does the same work.
+        // The global index is approximate and left out.
+        Suite set2;
+        set2.binary = bin + "/set2";
+        set2.trainingShapes = {SYNTHETIC_RED};
+        set2.testingShapes = {SYNTHETIC_RED, SYNTHETIC_ROUND, SYNTHETIC_QUAD};
+        string model = work + "/set2.ndm";
+        set2.modes.push_back({"baseline", {training, testing, "--verbose", "--model=" + model}, "responses.txt",
+                              model});
+        string cascadeModel = work + "/set2-cascade.ndm";
+        set2.modes.push_back({"cascade", {training, testing, "--model=" + cascadeModel}, "responses.txt",
+                              cascadeModel});
+        string workersModel = work + "/set2-workers.ndm";
+        set2.modes.push_back({"workers", {training, testing, "--workers=4", "--model=" + workersModel},
+                              "responses.txt", workersModel});
+        all["set2"] = set2;
+
+        // exact prototypes settle straddling clusters member by member, and
+        // the cache is run cold, then warm
+        Suite set3;
+        set3.binary = bin + "/set3";
+        set3.trainingShapes = {SYNTHETIC_ROUND};
+        set3.testingShapes = {SYNTHETIC_ROUND, SYNTHETIC_RED, SYNTHETIC_TRIANGLE};
+        string cache = "--feature-cache=" + work + "/set3-cache";
+        set3.modes.push_back({"baseline", {training, testing, "--headless", "--threads=1"}, ""});
+        set3.modes.push_back({"threads", {training, testing, "--headless"}, ""});
+        set3.modes.push_back({"cache-cold", {training, testing, "--headless", cache}, "", "", work + "/set3-cache"});
+        set3.modes.push_back({"cache-warm", {training, testing, "--headless", cache}, ""});
+        set3.modes.push_back({"prototypes", {training, testing, "--headless", "--prototypes"}, ""});
+        all["set3"] = set3;
+
+        return all;
+}
+
+// every frame of set1's streaming output, in the order printed
+static vector<pair<unsigned long, int> > readStreamVerdicts(const string &path) {
+        vector<pair<unsigned long, int> > verdicts;
+        ifstream file(path.c_str());
+        unsigned long index;
+        int verdict;
+        while (file >> index >> verdict) {
+                verdicts.push_back(make_pair(index, verdict));
+        }
+        return verdicts;
+}
+
+struct StreamSummary {
+        unsigned long classified = 0;
+        unsigned long unusable = 0;
+        unsigned long dropped = 0;
+        unsigned long skipped = 0;
+};
+
+static bool readStreamSummary(const string &path, StreamSummary &summary) {
+        ifstream file(path.c_str());
+        string line;
+        while (getline(file, line)) {
+                if (sscanf(line.c_str(), "Frames classified: %lu\tunusable: %lu\tdropped: %lu\tskipped: %lu",
+                           &summary.classified, &summary.unusable, &summary.dropped, &summary.skipped) == 4) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+// what set1 --stream prints for a frame, classified here the same way
+static int streamVerdict(const Mat &image) {
+        Frame frame;
+        if (!frame.assign(image)) {
+                return -1;
+        }
+        int numberOfSides = countPolygonSides(frame.gray());
+        return numberOfSides < 0 ? -1 : shapeVerdict(numberOfSides);
+}
+
+// Checks one streaming run: without a budget every frame is printed once,
+// in order, with its expected verdict; with one the frames that were
+// printed are in order and right, and every other frame was dropped or
+// skipped.
+static bool checkStream(const string &name, const string &directory, const vector<int> &expected, bool budget) {
+        auto verdicts = readStreamVerdicts(directory + "/stdout.txt");
+        StreamSummary summary;
+        if (!readStreamSummary(directory + "/stderr.txt", summary)) {
+                cerr << "stream " << name << ": no summary" << endl;
+                return false;
+        }
+
+        bool ok = true;
+        long last = -1;
+        for (auto &verdict : verdicts) {
+                if (verdict.first >= expected.size() || (long)verdict.first <= last) {
+                        cerr << "stream " << name << ": frame " << verdict.first << " out of order" << endl;
+                        return false;
+                }
+                last = verdict.first;
+                if (verdict.second != expected[verdict.first]) {
+                        cerr << "stream " << name << ": frame " << verdict.first << " " << verdict.second
+                             << ", expected " << expected[verdict.first] << endl;
+                        ok = false;
+                }
+        }
+
+        unsigned long frames = expected.size();
+        if (verdicts.size() != summary.classified
+            || summary.classified + summary.dropped + summary.skipped != frames) {
+                cerr << "stream " << name << ": " << summary.classified << " classified, " << summary.dropped
+                     << " dropped and " << summary.skipped << " skipped of " << frames << " frames" << endl;
+                ok = false;
+        }
+        if (!budget && summary.classified != frames) {
+                cerr << "stream " << name << ": frames lost without a latency budget" << endl;
+                ok = false;
+        }
+        if (budget && summary.dropped + summary.skipped == 0) {
+                cerr << "stream " << name << ": nothing dropped or skipped within the budget" << endl;
+                ok = false;
+        }
+        cout << "stream\t" << name << "\t" << summary.classified << " classified\t" << summary.unusable
+             << " unusable\t" << summary.dropped << " dropped\t" << summary.skipped << " skipped" << endl;
+        return ok;
+}
+
+// set1's streaming mode over generated frames, every fourth one blank so
+// it shows no contour: a raw BGR pipe, a raw file under a latency budget
+// too tight for any frame, and a video file when this OpenCV can write one
+static bool streamSuite(const string &bin, const string &work, Size size, int count, unsigned seed) {
+        if (!makeDirectory(work)) {
+                cerr << "Cannot create " << work << endl;
+                return false;
+        }
+        string set1 = bin + "/set1";
+
+        vector<int> shapes{SYNTHETIC_TRIANGLE, SYNTHETIC_QUAD, SYNTHETIC_ROUND};
+        auto images = generateSyntheticImages(shapes, count, size, seed);
+        vector<Mat> frames;
+        for (auto &image : images) {
+                if (frames.size() % 4 == 3) {
+                        frames.push_back(Mat(size, CV_8UC3, Scalar::all(255)));
+                }
+                frames.push_back(image.image);
+        }
+        vector<int> expected;
+        for (auto &frame : frames) {
+                expected.push_back(streamVerdict(frame));
+        }
+        for (size_t i = 3; i < frames.size(); i += 4) {
+                if (expected[i] != -1) {
+                        cerr << "stream: blank frame " << i << " has a contour" << endl;
+                        return false;
+                }
+        }
+
+        ostringstream format;
+        format << size.width << "x" << size.height << "x3";
+        string raw = "--raw=" + format.str();
+        bool ok = true;
+
+        // raw frames written into a pipe while set1 reads them
+        int pipeEnds[2];
+        if (pipe2(pipeEnds, O_CLOEXEC) != 0) {
+                cerr << "stream: cannot create a pipe" << endl;
+                return false;
+        }
+        thread writer([&] {
+                for (auto &frame : frames) {
+                        size_t bytes = frame.total() * frame.elemSize(), written = 0;
+                        while (written < bytes) {
+                                ssize_t chunk = write(pipeEnds[1], frame.ptr() + written, bytes - written);
+                                if (chunk < 0 && errno == EINTR) {
+                                        continue;
+                                }
+                                if (chunk <= 0) {
+                                        break;
+                                }
+                                written += chunk;
+                        }
+                }
+                close(pipeEnds[1]);
+        });
+        Run run;
+        bool started = runMode(set1, {"pipe", {"--stream=-", raw}, ""}, work + "/pipe", run, pipeEnds[0]);
+        close(pipeEnds[0]);
+        writer.join();
+        ok = started && checkStream("pipe", work + "/pipe", expected, false) && ok;
+
+        // the same frames from a file, every one older than the budget
+        string rawPath = work + "/frames.raw";
+        {
+                ofstream file(rawPath.c_str(), ios::binary);
+                for (auto &frame : frames) {
+                        file.write((const char *)frame.ptr(), frame.total() * frame.elemSize());
+                }
+                file.close();
+                if (!file) {
+                        cerr << "stream: cannot write " << rawPath << endl;
+                        return false;
+                }
+        }
+        started = runMode(set1, {"budget", {"--stream=" + rawPath, raw, "--latency-budget=0.001"}, ""},
+                          work + "/budget", run);
+        ok = started && checkStream("budget", work + "/budget", expected, true) && ok;
+
+        // a video holds lossy frames, they are classified as read back
+        string videoPath = work + "/frames.avi";
+        VideoWriter video(videoPath, CV_FOURCC('M', 'J', 'P', 'G'), 10, size, true);
+        if (!video.isOpened()) {
+                cout << "stream\tvideo\tskipped, no video writer" << endl;
+                return ok;
+        }
+        for (auto &frame : frames) {
+                video.write(frame);
+        }
+        video.release();
+        vector<int> videoExpected;
+        VideoCapture capture(videoPath);
+        Mat frame;
+        while (capture.read(frame)) {
+                videoExpected.push_back(streamVerdict(frame));
+        }
+        if (videoExpected.size() != frames.size()) {
+                cerr << "stream: " << videoExpected.size() << " of " << frames.size() << " video frames read back" << endl;
+                return false;
+        }
+        started = runMode(set1, {"video", {"--stream=" + videoPath}, ""}, work + "/video", run);
+        return started && checkStream("video", work + "/video", videoExpected, false) && ok;
+}
+
+static string timestamp() {
+        char text[32];
+        time_t now = time(nullptr);
+        strftime(text, sizeof(text), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+        return text;
+}
+
+int main(int argc, char **argv) {
+        Options options(argc, argv);
+
+        string argv0 = argv[0];
+        string bin = absolutePath(options.get("bin", argv0.find('/') == string::npos
+                                                   ? "." : argv0.substr(0, argv0.find_last_of('/'))));
+        string suiteName = options.get("suite");
+        string work = absolutePath(options.get("work", "regression"));
+        int count = options.getInt("count", 48);
+        unsigned seed = options.getInt("seed", 1);
+        double maxSlowdown = options.getDouble("max-slowdown", 2);
+        int repeat = options.getInt("repeat", 3);
+        double maxRegression = options.getDouble("max-regression", 0);
+        Size size(options.getInt("width", 640), options.getInt("height", 480));
+
+        // a writer into set1's pipe must not die with set1
+        signal(SIGPIPE, SIG_IGN);
+        if (suiteName == "stream") {
+                exit(streamSuite(bin, work + "/stream", Size(options.getInt("width", 320), options.getInt("height", 240)),
+                                 options.getInt("count", 24), seed) ? 0 : 1);
+        }
+
+        auto all = suites(bin, work + "/" + suiteName + "/data", work + "/" + suiteName);
+        if (!all.count(suiteName) || count <= 0 || maxSlowdown <= 0 || repeat <= 0
+            || maxRegression < 0 || maxRegression >= 1) {
+                cerr << "Usage: ndregress --suite=set1|set2|set3|stream [--bin=<dir>] [--work=<dir>] [--results=<path>]"
+                     << " [--count=<n>] [--seed=<n>] [--repeat=<n>] [--max-slowdown=<ratio>]"
+                     << " [--max-regression=<fraction>]" << endl;
+                exit(-1);
+        }
+        const Suite &suite = all[suiteName];
+        string suiteWork = work + "/" + suiteName;
+        string resultsPath = options.get("results", work + "/results.tsv");
+
+        // the same seed gives the same images, so runs stay comparable
+        string data = suiteWork + "/data";
+        if (!makeDirectory(work) || !makeDirectory(suiteWork) || !makeDirectory(data)
+            || !makeDirectory(data + "/training") || !makeDirectory(data + "/testing")) {
+                cerr << "Cannot create " << data << endl;
+                exit(-1);
+        }
+        if ((!suite.trainingShapes.empty()
+             && !writeSyntheticImages(generateSyntheticImages(suite.trainingShapes, count, size, seed),
+                                      data + "/training"))
+            || !writeSyntheticImages(generateSyntheticImages(suite.testingShapes, count, size, seed + 1),
+                                     data + "/testing")) {
+                cerr << "Cannot write images to " << data << endl;
+                exit(-1);
+        }
+
+        auto best = bestRates(resultsPath);
+        ofstream results(resultsPath.c_str(), ios::app);
+        if (!results.is_open()) {
+                cerr << "Cannot write results " << resultsPath << endl;
+                exit(-1);
+        }
+
+        // set2 and set3 go through their training images as well
+        int images = suite.trainingShapes.empty() ? count : 2 * count;
+        string startedAt = timestamp();
+        bool failed = false;
+        Run baseline;
+        for (size_t m = 0; m < suite.modes.size(); m++) {
+                const Mode &mode = suite.modes[m];
+                // the fastest of the runs is timed, the verdicts are the last run's
+                Run run;
+                bool ran = true;
+                for (int r = 0; r < repeat && ran; r++) {
+                        if (!mode.cleared.empty()) {
+                                removeTree(mode.cleared);
+                        }
+                        Run attempt;
+                        ran = runMode(suite.binary, mode, suiteWork + "/" + mode.name, attempt);
+                        if (r > 0) {
+                                attempt.seconds = min(attempt.seconds, run.seconds);
+                                attempt.peakRssKb = max(attempt.peakRssKb, run.peakRssKb);
+                        }
+                        run = attempt;
+                }
+                if (!ran) {
+                        cerr << suiteName << " " << mode.name << ": failed, see " << suiteWork << "/" << mode.name
+                             << "/stderr.txt" << endl;
+                        failed = true;
+                        if (m == 0) {
+                                break;
+                        }
+                        continue;
+                }
+                if (m == 0) {
+                        baseline = run;
+                }
+
+                string examples;
+                int drift = verdictDrift(baseline.verdicts, run.verdicts, examples);
+                double rate = images / run.seconds;
+                double slowdown = run.seconds / baseline.seconds;
+                double bestRate = best[suiteName + "\t" + mode.name];
+
+                cout << suiteName << "\t" << mode.name << "\t" << run.verdicts.size() << " verdicts\t"
+                     << run.seconds << " s\t" << rate << " images/s\t" << run.peakRssKb << " KB";
+                if (m > 0) {
+                        cout << "\t" << slowdown << "x baseline time";
+                }
+                cout << endl;
+                results << startedAt << "\t" << suiteName << "\t" << mode.name << "\t" << images << "\t"
+                        << run.seconds << "\t" << rate << "\t" << run.peakRssKb << "\t"
+                        << (drift ? "drift" : "same") << endl;
+
+                if (run.verdicts.empty()) {
+                        cerr << suiteName << " " << mode.name << ": no verdicts" << endl;
+                        failed = true;
+                }
+                if (drift) {
+                        cerr << suiteName << " " << mode.name << ": " << drift << " verdicts differ from baseline:"
+                             << examples << endl;
+                        failed = true;
+                }
+                if (m > 0 && !mode.artifact.empty() && !sameBytes(suite.modes[0].artifact, mode.artifact)) {
+                        cerr << suiteName << " " << mode.name << ": " << mode.artifact << " differs from "
+                             << suite.modes[0].artifact << endl;
+                        failed = true;
+                }
+                if (m > 0 && slowdown > maxSlowdown) {
+                        cerr << suiteName << " " << mode.name << ": " << slowdown << "x the baseline time, more than "
+                             << maxSlowdown << "x" << endl;
+                        failed = true;
+                }
+                if (maxRegression > 0 && bestRate > 0 && rate < bestRate * (1 - maxRegression)) {
+                        cerr << suiteName << " " << mode.name << ": " << rate << " images/s, more than "
+                             << maxRegression * 100 << "% below the best recorded " << bestRate << endl;
+                        failed = true;
+                }
+        }
+        return failed ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+#include <cstring>
+
+#include "score_file.hpp"
+
+using namespace std;
+
+static const char SCORE_MAGIC[4] = {'N', 'D', 'S', 'C'};
+
+static_assert(sizeof(ScoreHeader) == 32, "score header must stay 32 bytes");
+
+bool ScoreWriter::open(const string &path, int kind, size_t trainingCount,
+                       const vector<double> &levels, double reference) {
+        file.open(path.c_str(), ios::binary | ios::trunc);
+        if (!file.is_open()) {
+                return false;
+        }
+
+        ScoreHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SCORE_MAGIC, sizeof(SCORE_MAGIC));
+        header.version = SCORE_FILE_VERSION;
+        header.kind = kind;
+        header.trainingCount = trainingCount;
+        header.levelCount = levels.size();
+        header.reference = reference;
+        file.write((const char *)&header, sizeof(header));
+        file.write((const char *)levels.data(), levels.size() * sizeof(double));
+
+        valueCount = levels.size() * trainingCount;
+        return (bool)file;
+}
+
+void ScoreWriter::add(const string &name, double scalar, const float *values) {
+        uint32_t length = name.size();
+        file.write((const char *)&length, sizeof(length));
+        file.write(name.data(), length);
+        file.write((const char *)&scalar, sizeof(scalar));
+        file.write((const char *)values, valueCount * sizeof(float));
+}
+
+bool ScoreWriter::close() {
+        file.close();
+        return !file.fail();
+}
+
+bool readScores(const string &path, ScoreSet &scores) {
+        ifstream file(path.c_str(), ios::binary);
+        ScoreHeader header;
+        if (!file.read((char *)&header, sizeof(header))
+            || memcmp(header.magic, SCORE_MAGIC, sizeof(SCORE_MAGIC)) != 0
+            || header.version != SCORE_FILE_VERSION) {
+                return false;
+        }
+
+        scores = ScoreSet();
+        scores.kind = header.kind;
+        scores.trainingCount = header.trainingCount;
+        scores.reference = header.reference;
+        scores.levels.resize(header.levelCount);
+        if (!file.read((char *)scores.levels.data(), header.levelCount * sizeof(double))) {
+                return false;
+        }
+
+        size_t stride = scores.stride();
+        uint32_t length;
+        while (file.read((char *)&length, sizeof(length))) {
+                string name(length, '\0');
+                double scalar;
+                size_t first = scores.values.size();
+                scores.values.resize(first + stride);
+                if (!file.read(&name[0], length) || !file.read((char *)&scalar, sizeof(scalar))
+                    || !file.read((char *)(scores.values.data() + first), stride * sizeof(float))) {
+                        // a truncated last record
+                        return false;
+                }
+                scores.names.push_back(name);
+                scores.scalars.push_back(scalar);
+        }
+        return true;
+}
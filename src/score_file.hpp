@@ -0,0 +1,78 @@
+#ifndef SCORE_FILE_HPP
+#define SCORE_FILE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Raw per-image scores behind the set2 and set3 verdicts, dumped once so
+// their thresholds can be calibrated offline without recomputing them.
+//
+// file layout (all integers little endian, as written by the host):
+//   ScoreHeader                         32 bytes
+//   double levels[levelCount]
+//   records until the end of the file, each
+//     uint32 name length, name bytes
+//     double scalar
+//     float values[levelCount * trainingCount], level after level
+//
+// set2 files hold the red pixel count as the scalar and the good match
+// count against every training image at each distance coefficient level.
+// set3 files hold the roundness as the scalar and the hue histogram
+// correlation with every training image on a single level, the threshold
+// the verdicts were made with; reference is the smallest training
+// roundness.
+
+const uint32_t SCORE_FILE_VERSION = 1;
+
+enum ScoreKind {
+        SCORES_FEATURES = 1,
+        SCORES_HUE = 2
+};
+
+struct ScoreHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t kind;
+        uint32_t trainingCount;
+        uint32_t levelCount;
+        uint32_t reserved;
+        double reference;
+};
+
+// scores of every image of a dump, values stored image after image
+struct ScoreSet {
+        int kind = 0;
+        size_t trainingCount = 0;
+        std::vector<double> levels;
+        double reference = 0;
+
+        std::vector<std::string> names;
+        std::vector<double> scalars;
+        std::vector<float> values;
+
+        size_t size() const { return names.size(); }
+        size_t stride() const { return levels.size() * trainingCount; }
+        const float *scores(size_t image, size_t level) const {
+                return &values[image * stride() + level * trainingCount];
+        }
+};
+
+// streams one record per test image, in the order they are classified
+class ScoreWriter {
+public:
+        bool open(const std::string &path, int kind, size_t trainingCount,
+                  const std::vector<double> &levels, double reference = 0);
+        // values holds levels.size() * trainingCount scores
+        void add(const std::string &name, double scalar, const float *values);
+        bool close();
+
+private:
+        std::ofstream file;
+        size_t valueCount = 0;
+};
+
+bool readScores(const std::string &path, ScoreSet &scores);
+
+#endif
@@ -0,0 +1,42 @@
+#include "metrics.hpp"
+#include "scratch.hpp"
+
+using namespace std;
+using namespace cv;
+
+Mat ScratchMat::view(Size size, int type) {
+        size_t needed = (size_t)size.area() * CV_ELEM_SIZE(type);
+        if (bytes.size() < needed) {
+                bytes.resize(needed);
+        }
+        return Mat(size, type, bytes.data());
+}
+
+void Scratch::checkpoint() {
+        // a vector's capacity and the bytes of a Mat only change when they
+        // are reallocated
+        const size_t current[] = {
+                threshold.capacity(), contour.capacity(), polygon.capacity(),
+                gray.capacity(), edges.capacity(), hsv.capacity(), hue.capacity(),
+                hueHist.total() * hueHist.elemSize(),
+                contourPoints.capacity(), hull.capacity(), pointDistances.capacity(),
+                hueCentered.capacity(), hueQuery.capacity()
+        };
+        size_t count = sizeof(current) / sizeof(current[0]);
+        capacities.resize(count, 0);
+
+        size_t moved = 0;
+        for (size_t i = 0; i < count; i++) {
+                if (current[i] != capacities[i]) {
+                        moved++;
+                }
+                capacities[i] = current[i];
+        }
+        allocationCount += moved;
+        ND_COUNT("scratch_allocations", moved);
+}
+
+Scratch &Scratch::local() {
+        thread_local Scratch scratch;
+        return scratch;
+}
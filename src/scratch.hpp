@@ -0,0 +1,64 @@
+#ifndef SCRATCH_HPP
+#define SCRATCH_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/core/core_c.h>
+
+// Storage that only grows. view() hands out a continuous Mat of the
+// requested size and type over it, so an OpenCV function given the view
+// as its output finds it already allocated and writes in place. Views are
+// whole matrices, not regions of a larger one, so filters reading them
+// extrapolate at their own borders; a view is valid until the next call.
+class ScratchMat {
+public:
+        cv::Mat view(cv::Size size, int type);
+        size_t capacity() const { return bytes.capacity(); }
+
+private:
+        std::vector<unsigned char> bytes;
+};
+
+// Buffers one worker reuses from image to image: Mats sized to the
+// largest frame seen so far and vectors that are cleared but keep their
+// capacity. Contours are found into a memory storage that is cleared,
+// not freed. checkpoint(), called once per image by the code using the
+// buffers, counts every buffer whose capacity changed since the previous
+// call, which only happens when it is reallocated, so once warmed up on
+// the largest image the count stays put; ndbench --check-scratch asserts
+// it. Temporaries OpenCV allocates inside its own functions are not seen.
+struct Scratch {
+        // shape_detector
+        ScratchMat threshold;
+        cv::MemStorage contourStorage;
+        std::vector<cv::Point> contour;
+        std::vector<cv::Point> polygon;
+
+        // object_analysis
+        ScratchMat gray;
+        ScratchMat edges;
+        ScratchMat hsv;
+        ScratchMat hue;
+        cv::Mat hueHist;
+        std::vector<cv::Point> contourPoints;
+        std::vector<cv::Point> hull;
+        std::vector<double> pointDistances;
+
+        // hue_correlation
+        std::vector<double> hueCentered;
+        std::vector<float> hueQuery;
+
+        void checkpoint();
+        size_t allocations() const { return allocationCount; }
+
+        // the scratch of the calling thread, one per pool worker
+        static Scratch &local();
+
+private:
+        std::vector<size_t> capacities;
+        size_t allocationCount = 0;
+};
+
+#endif
@@ -1,79 +1,198 @@
+#include <chrono>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+#include "bounded_queue.hpp"
+#include "frame.hpp"
+#include "file_enumerator.hpp"
+#include "frame_source.hpp"
+#include "image_loader.hpp"
+#include "metrics.hpp"
+#include "options.hpp"
+#include "reduced_decode.hpp"
+#include "shape_detector.hpp"
+
 using namespace std;
 using namespace cv;
 
-// minimum safe value times 2
-const double APPROXPOLYDP_EPS = 20.0;
-
 // strings
 const char* STR_TRIANGLE = "triangle";
 const char* STR_QUAD = "quadrilateral";
 const char* STR_UNKNOWNFIG = "UNKNOWN";
 
-void sortFiles (vector<string> &names){
-        sort (names.begin(), names.end(), [](std::string s1, std::string s2) {
-                auto number1 = std::stoi(s1.substr(s1.find_last_of("/") + 1, s1.find_last_of(".")));
-                auto number2 = std::stoi(s2.substr(s2.find_last_of("/") + 1, s2.find_last_of(".")));
-                return number1 < number2;
+typedef chrono::steady_clock Clock;
+
+// frames read ahead of the classifier
+const int STREAM_QUEUE_DEPTH = 2;
+
+struct StreamedFrame {
+        unsigned long index;
+        Mat image;
+        Clock::time_point received;
+};
+
+// Classifies frames as they arrive, one "<frame index>\t<verdict>" line
+// each, -1 for a frame that was empty or showed no contour. With a
+// latency budget the reader never waits for the classifier: when the
+// queue is full the oldest frame is dropped, and a frame older than the
+// budget when its turn comes is skipped. Without one every frame is
+// classified and the reader waits.
+int streamShapes(FrameSource &source, double budgetMs) {
+        BoundedQueue<StreamedFrame> queue(STREAM_QUEUE_DEPTH);
+        unsigned long dropped = 0;
+
+        thread reader([&] {
+                for (unsigned long index = 0;; index++) {
+                        StreamedFrame frame;
+                        if (!source.read(frame.image)) {
+                                break;
+                        }
+                        frame.index = index;
+                        frame.received = Clock::now();
+                        if (budgetMs <= 0) {
+                                queue.push(move(frame));
+                                continue;
+                        }
+                        bool evicted;
+                        queue.pushEvictingOldest(move(frame), evicted);
+                        if (evicted) {
+                                dropped++;
+                                ND_COUNT("frames_dropped", 1);
+                        }
+                }
+                queue.close();
         });
+
+        unsigned long classified = 0, skipped = 0, unusable = 0;
+        StreamedFrame frame;
+        while (queue.pop(frame)) {
+                double age = chrono::duration<double, milli>(Clock::now() - frame.received).count();
+                if (budgetMs > 0 && age > budgetMs) {
+                        skipped++;
+                        ND_COUNT("frames_skipped", 1);
+                        continue;
+                }
+
+                int verdict = -1;
+                Frame view;
+                if (view.assign(frame.image)) {
+                        int numberOfSides = countPolygonSides(view.gray());
+                        if (numberOfSides >= 0) {
+                                verdict = shapeVerdict(numberOfSides);
+                        }
+                }
+                if (verdict < 0) {
+                        unusable++;
+                        ND_COUNT("frames_unusable", 1);
+                }
+                classified++;
+                cout << frame.index << "\t" << verdict << endl;
+        }
+        reader.join();
+
+        cerr << "Frames classified: " << classified << "\tunusable: " << unusable
+             << "\tdropped: " << dropped << "\tskipped: " << skipped << endl;
+        return 0;
+}
+
+// polygon sides of one encoded file, -1 when it shows no contour
+int classifyFile(const Mat &encodedImage, int scale) {
+        int numberOfSides = -1;
+        if (scale > 1) {
+                numberOfSides = countPolygonSidesReduced(decodeReducedGray(encodedImage, scale), scale);
+        }
+        if (numberOfSides < 0) {
+                if (scale > 1) {
+                        ND_COUNT("reduced_fallbacks", 1);
+                }
+                Frame frame;
+                frame.decode(encodedImage, FRAME_GRAY);
+                numberOfSides = countPolygonSides(frame.gray());
+        }
+        return numberOfSides;
 }
 
 int main (int argc, char** argv) {
 
+        Options options(argc, argv);
+        if (!setupMetrics(options)) {
+                exit (-1);
+        }
+
+        // live input instead of a directory of files
+        string streamLocation = options.get("stream");
+        if (!streamLocation.empty()) {
+                auto source = openFrameSource(streamLocation, options.get("raw"));
+                if (!source) {
+                        exit (-1);
+                }
+                exit (streamShapes(*source, options.getDouble("latency-budget", 0)));
+        }
+
         // check argument
-        if (argc < 2) {
+        if (options.positional().empty()) {
                 cerr << "No directory given" << endl;
                 exit (-1);
         }
 
-        // load file names
-        vector<string> fileNames;
-        glob((string(argv[1]) + "/*.jpg"), fileNames, false);
-        auto numberOfFiles = fileNames.size();
-
-        sortFiles(fileNames);
+        // decode at 1/2, 1/4 or 1/8 first, full resolution only when needed
+        int scale = options.getInt("scale", 1);
+        if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+                cerr << "Scale must be 1, 2, 4 or 8" << endl;
+                exit (-1);
+        }
 
-        // cout << "Found " << numberOfFiles << " files in " << argv[1] << endl;
+        // files are analyzed as the directory is listed, verdicts are
+        // printed in file number order once the listing is complete
+        DirectoryEnumerator files;
+        if (!files.start(options.positional()[0], ".jpg")) {
+                cerr << "Cannot read directory " << options.positional()[0] << endl;
+                exit (-1);
+        }
+        OrderedResults<int> sides;
 
         // counters
         unsigned quadsFound = 0;
         unsigned trianglesFound = 0;
         unsigned unknownsFound = 0;
 
-        // analyze images
-        for (auto file : fileNames) {
-                // cout << endl << "Analyzing file: " << file << endl;
-                Mat image = imread(file.c_str(), CV_LOAD_IMAGE_GRAYSCALE);
-
-                // invert image
-                threshold (image, image, 200, 255, THRESH_BINARY_INV);
+        // files are read ahead as they are listed, and decoded from memory
+        ImageLoader loader([&files](string &path) {
+                NumberedFile listed;
+                if (!files.next(listed)) {
+                        return false;
+                }
+                path = listed.path;
+                return true;
+        });
 
-                // finding contours
-                vector< vector<Point> > contours;
-                findContours (image, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+        // analyze images
+        LoadedFile loaded;
+        while (loader.next(loaded)) {
+                // cout << endl << "Analyzing file: " << loaded.path << endl;
+                NumberedFile file(loaded.path);
+                sides.expect(file);
+                sides.add(file, classifyFile(loaded.bytes, scale));
+                loader.release(loaded);
+        }
+        sides.finish();
 
-                if (contours.size() < 1) {
+        string path;
+        int numberOfSides;
+        while (sides.next(path, numberOfSides)) {
+                if (numberOfSides < 0) {
                         // cout << "No contours found - skipping" << endl;
                         break;
                 }
 
-                // cout << "\tFound " << contours.size() << (contours.size() == 1 ? " contour" : " contours - WARNING: there should be only one contour per image") << endl;
-
-                // counting edges
-                vector<Point> polygon (contours.size());
-                approxPolyDP (contours[0], polygon, APPROXPOLYDP_EPS, true);
-
-                auto numberOfSides = polygon.size();
-
-                auto fileNameOnly = file.substr(file.find_last_of('/')+1);
-                cout << fileNameOnly << "\t" << (int) (!(numberOfSides == 3 or numberOfSides == 4)) << endl;
+                auto fileNameOnly = path.substr(path.find_last_of('/')+1);
+                cout << fileNameOnly << "\t" << shapeVerdict(numberOfSides) << endl;
 
                 // get figure type
                 // string figureName = "";
@@ -1,3 +1,4 @@
+# include <climits>
 # include <iostream>
 # include <string>
 # include <vector>
@@ -9,33 +10,42 @@
 # include "opencv2/features2d/features2d.hpp"
 # include "opencv2/highgui/highgui.hpp"
 # include "opencv2/imgproc/imgproc.hpp"
-# include "opencv2/nonfree/features2d.hpp"
+
+# include "frame.hpp"
+# include "image_loader.hpp"
+# include "metrics.hpp"
+# include "options.hpp"
+# include "score_file.hpp"
+# include "surf_detector.hpp"
 
 using namespace std;
 using namespace cv;
 
-// acceptable value of matches, determined by trial and error
-const int ACCEPTABLE_MATCH = 52;
-
-// determine min hessian value
-const int MIN_HESSIAN = 1000;
-
-// distance coefficient, determined by trial and error
-const double DIST_COEFF = 0.7;
-
-// max and min values of non black pixels, determined by trial and error
-const int NON_BLACK_MAX = 3562;
-const int NON_BLACK_MIN = 85;
-
+// distance coefficients good matches are counted at for --dump-scores
+const vector<double> SCORE_DIST_COEFFS = {0.6, 0.65, 0.7, 0.75, 0.8};
 
 int main( int argc, char** argv )
 {
+  Options options(argc, argv);
+  if (!setupMetrics(options)) {
+    exit (-1);
+  }
+
+  // per file match details, stage timings and counts go to --metrics
+  bool verbose = options.has("verbose");
+
   // check arguments
-  if (argc < 3) {
+  if (options.positional().size() < 2) {
     cerr << "You should give 2 directories" << endl;
     exit (-1);
   }
 
+  string trainingDir = options.positional()[0];
+  string testingDir = options.positional()[1];
+
+  // binary model file, reused as is with --no-train
+  string modelPath = options.get("model", "template.ndm");
+
   // file containing responses
   ofstream fileWithResponses;
 
@@ -45,167 +55,134 @@ int main( int argc, char** argv )
   // load files from training and (testing or novelty) directory
   vector<string> fileNamesInDir1, fileNamesInDir2;
 
-  glob((string(argv[1]) + "/*.jpg"), fileNamesInDir1, false);
-  glob((string(argv[2]) + "/*.jpg"), fileNamesInDir2, false);
+  glob(trainingDir + "/*.jpg", fileNamesInDir1, false);
+  glob(testingDir + "/*.jpg", fileNamesInDir2, false);
 
   auto numberOfFilesInDir1 = fileNamesInDir1.size();
   auto numberOfFilesInDir2 = fileNamesInDir2.size();
 
-  cout << "Found " << numberOfFilesInDir1 << " files in " << argv[1] << endl;
-  cout << "Found " << numberOfFilesInDir2 << " files in " << argv[2] << endl;
-
-  // detect the keypoints using SURF Detector
-  SurfFeatureDetector detector(MIN_HESSIAN);
-
-  vector<KeyPoint> keypoints_1, keypoints_2;
+  cout << "Found " << numberOfFilesInDir1 << " files in " << trainingDir << "\n";
+  cout << "Found " << numberOfFilesInDir2 << " files in " << testingDir << "\n";
 
   // initialize counter for photos
   int matchingPhotosCount = 0;
 
-  // number of pixels that are not black in photo
-  vector<Point> nonBlackPixels;
-
   // count matches after using FLANN method
   vector<int> matchesCount;
 
-  Mat descriptors_1, descriptors_2;
-
-  // calculate descriptors (feature vectors)
-  SurfDescriptorExtractor extractor;
-  FileStorage store("template.xml", FileStorage::WRITE);
-
-  int counter = 0;
-
-  // iterate over images found in training directory
-  for (auto file : fileNamesInDir1) {
-    ostringstream outputName;
+  Mat descriptors_1;
 
-    counter++;
-    Mat image = imread(file.c_str(), CV_LOAD_IMAGE_GRAYSCALE);
-
-    detector.detect(image, keypoints_1);
-    extractor.compute(image, keypoints_1, descriptors_1);
-
-    outputName << "descriptors_" << counter;
+  if (!options.has("no-train")) {
+    // iterate over images found in training directory
+    FeatureModelParams params;
+    if (!parseFeatureModelParams(options, params)) {
+      exit (-1);
+    }
+    // FLANN is tuned on the test images the model will see
+    params.tuningQueries = fileNamesInDir2;
+    if (!trainFeatureModel(fileNamesInDir1, modelPath, params, options.getInt("workers", 1))) {
+      cerr << "Cannot write model " << modelPath << endl;
+      exit (-1);
+    }
 
-    write(store, outputName.str(), descriptors_1);
+    cout << "Analysis finished\n";
   }
 
-  cout << "Analysis finished" << endl;
+  FeatureMatcher matcher;
+  if (!matcher.open(modelPath, options.has("global-index"))) {
+    cerr << "Cannot read model " << modelPath << endl;
+    exit (-1);
+  }
 
-  store.release();
+  // the backend comes from the model, so does the default threshold
+  int acceptable = options.getInt("acceptable-match", acceptableMatch(matcher.backend()));
 
-  // open storage file
-  store.open("template.xml", FileStorage::READ);
   fileWithResponses.open("responses.txt");
 
-  // iterate over images found in testing or novelty directory
-  for (auto testFile : fileNamesInDir2) {
-    matchesCount.clear();
-
-    cout << endl << "Analyzing file: " << testFile << endl;
-    Mat testImage = imread(testFile.c_str(), CV_LOAD_IMAGE_GRAYSCALE);
-
-    detector.detect(testImage, keypoints_1);
-    extractor.compute(testImage, keypoints_1, descriptors_1);
-
-    // compare against every image from dir1
-    for (size_t i=1; i<= fileNamesInDir1.size(); i++) {
-      ostringstream inputName;
-      inputName << "descriptors_" << i;
-      store[inputName.str()] >>  descriptors_2;
+  // without --verbose only the gates needed for the verdict run, the
+  // cheapest rejecting one first
+  GateCascade<Frame> cascade;
+  addSurfGates(cascade, matcher, acceptable);
 
-      cout << "Matching against " << inputName.str() << endl;
-      // match descriptor vectors using FLANN matcher
-      FlannBasedMatcher matcher;
-      vector< vector<DMatch> > matches;
-
-      cout << "DESCRIPTOR 1 ROWS " << descriptors_1.rows << endl;
-      cout << "DESCRIPTOR 2 ROWS " << descriptors_2.rows << endl;
-      matcher.knnMatch(descriptors_1, descriptors_2, matches, 2);
-
-      // max and min distance between keypoints
-      int max_dist = 0;
-      int min_dist = 100;
-
-      // calculate max and min distances between keypoints
-      for(int i = 0; i < descriptors_1.rows; i++) {
-        double dist = matches[i][0].distance;
-        if( dist < min_dist ) min_dist = dist;
-        if( dist > max_dist ) max_dist = dist;
-      }
-
-      vector<DMatch> goodMatches;
-
-      for(int i = 0; i < descriptors_1.rows; i++) {
-        const DMatch &m1 = matches[i][0];
-        const DMatch &m2 = matches[i][1];
-
-        if (m1.distance <= DIST_COEFF * m2.distance) {
-          goodMatches.push_back(m1);
+  // raw scores of every test image for ndsweep, computed on top of the verdict
+  ScoreWriter scores;
+  string scoresPath = options.get("dump-scores");
+  if (!scoresPath.empty() && !scores.open(scoresPath, SCORES_FEATURES, matcher.size(), SCORE_DIST_COEFFS)) {
+    cerr << "Cannot write scores " << scoresPath << endl;
+    exit (-1);
+  }
+  vector<float> scoreValues;
+
+  // iterate over images found in testing or novelty directory, read
+  // ahead while the previous ones are matched
+  ImageLoader loader(fileNamesInDir2);
+  LoadedFile testFile;
+  while (loader.next(testFile)) {
+    // decoded once, the gray view is derived from the same pixels
+    Frame testFrame;
+    testFrame.decode(testFile.bytes, FRAME_GRAY | FRAME_BGR);
+    loader.release(testFile);
+
+    int verdict;
+    if (verbose) {
+      matcher.computeDescriptors(testFrame.gray(), descriptors_1);
+      matcher.countMatches(descriptors_1, matchesCount);
+
+      // calculate smallest and largest number of matches
+      int smallestNumOfMatches = *min_element(matchesCount.begin(), matchesCount.end());
+      int largestNumOfMatches = *max_element(matchesCount.begin(), matchesCount.end());
+
+      // implement matching by red colour
+      int nonBlackPixels = countRedPixels(testFrame.bgr());
+
+      // display all matches
+      cout << "\nAnalyzing file: " << testFile.path << "\n[";
+      for (int i = 0; i < (int)matchesCount.size(); i++) {
+        cout << matchesCount[i];
+        if (i < (int)matchesCount.size() - 1){
+          cout << ", ";
         }
       }
+      cout << "]\n";
 
-      cout << goodMatches.size() << endl;
-      matchesCount.push_back(goodMatches.size());
-    }
+      // display smallest and largest number of matches
+      cout << "Smallest number of matches: " << smallestNumOfMatches << "\n";
+      cout << "Largest number of matches: " << largestNumOfMatches << "\n";
+      cout << "Amount of nonBlackPixels: " << nonBlackPixels << "\n";
 
-    // display all matches
-    cout << "[";
-    for (int i = 0; i < (int)matchesCount.size(); i++) {
-      cout << matchesCount[i];
-      if (i < (int)matchesCount.size() - 1){
-        cout << ", ";
-      }
+      verdict = surfVerdict(largestNumOfMatches, nonBlackPixels, acceptable);
+    } else {
+      verdict = cascade.run(testFrame) ? 0 : 1;
     }
-    cout << "]" << endl;
-
-    // calculate smallest and largest number of matches
-    int smallestNumOfMatches = *min_element(matchesCount.begin(), matchesCount.end());
-    int largestNumOfMatches = *max_element(matchesCount.begin(), matchesCount.end());
 
-    // display smallest and largest number of matches
-    cout << "Smallest number of matches: " << smallestNumOfMatches << endl;
-    cout << "Largest number of matches: " << largestNumOfMatches << endl;
+    nameOfPicture = testFile.path;
 
-    // implement matching by red colour
-    Mat1b mask1, mask2;
-    Mat3b hsv;
-
-    Mat3b imageBgr = imread(testFile.c_str());
-    cvtColor(imageBgr, hsv, COLOR_BGR2HSV);
-
-    // determine range of redness
-    inRange(hsv, Scalar(0, 70, 50), Scalar(10, 255, 255), mask1);
-    inRange(hsv, Scalar(120, 70, 50), Scalar(210, 255, 255), mask2);
-
-    Mat1b mask = mask1 | mask2;
-
-    // find nonzero pixels
-    findNonZero(mask, nonBlackPixels);
-
-    cout << "Amount of nonBlackPixels: " << nonBlackPixels.size() << endl;
-
-    nameOfPicture = (string)testFile.c_str();
-
-    if (largestNumOfMatches >= ACCEPTABLE_MATCH &&
-      (nonBlackPixels.size() >= NON_BLACK_MIN) &&
-      (nonBlackPixels.size() <= NON_BLACK_MAX)) {
+    if (!scoresPath.empty()) {
+      // every count at every level, and the red count without its early stop
+      matcher.computeDescriptors(testFrame.gray(), descriptors_1);
+      scoreValues.clear();
+      for (double distCoeff : SCORE_DIST_COEFFS) {
+        matcher.countMatches(descriptors_1, matchesCount, distCoeff);
+        scoreValues.insert(scoreValues.end(), matchesCount.begin(), matchesCount.end());
+      }
+      scores.add(nameOfPicture.substr(nameOfPicture.find_last_of("/\\") + 1),
+                 countRedPixels(testFrame.bgr(), INT_MAX), scoreValues.data());
+    }
 
+    if (verdict == 0) {
       matchingPhotosCount++;
-      fileWithResponses << nameOfPicture.substr(nameOfPicture.find_last_of("/\\") + 1) << "\t" << 0 << endl;
-    } else {
-      fileWithResponses << nameOfPicture.substr(nameOfPicture.find_last_of("/\\") + 1) << "\t" << 1 << endl;
     }
+    fileWithResponses << nameOfPicture.substr(nameOfPicture.find_last_of("/\\") + 1) << "\t" << verdict << "\n";
   }
 
   fileWithResponses.close();
-  store.release();
+  if (!scoresPath.empty() && !scores.close()) {
+    cerr << "Cannot write scores " << scoresPath << endl;
+    exit (-1);
+  }
 
   cout << "Total photos matching: " << matchingPhotosCount << "/" << fileNamesInDir2.size() << endl;
 
-  waitKey(0);
-
   return 0;
 }
 
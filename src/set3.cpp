@@ -1,63 +1,41 @@
-
 #include <algorithm>
-#include <cmath>
 #include <iomanip>
 #include <iostream>
-#include <numeric>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <opencv2/core/core.hpp>
-#include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "file_enumerator.hpp"
+#include "metrics.hpp"
+#include "object_analysis.hpp"
+#include "options.hpp"
+#include "score_file.hpp"
 
 using namespace std;
 using namespace cv;
 
-const int LOW_THRESHOLD = 25;
-const int THRESH_RATIO = 3;
-const int CANNY_KERNEL_SIZE = 3;
-const int BLUR_KERNEL_SIZE = 4;
-const float ROUNDNESS_LIMIT_MARGIN = 0.05;
-const float ROUNDNESS_PASS_LIMIT = 0.80;
-const int HUE_HIST_BINS = 23;
-const float HUE_HIST_MIN_CORREL = 0.87;
-const int HUE_HIST_MIN_MATCHES = 6;
-const float WEIGHT_ROUNDNESS = 0.2;
-const float WEIGHT_HUE_HIST = 0.8;
-const int OBJECT_TYPES = 6;
-
-typedef struct {
-        string fileName;
-        double roundness;
-        bool roundnessPass;
-        vector<double> hu;
-        Mat hueImage;
-        Mat hueHist;
-        bool hueHistPass;
-        float score;
-        vector<int> huLabels;
-} ObjectData;
-
-void sortFiles (vector<string> &names);
-vector<ObjectData> analyzeImages (vector<string> &fileNames);
-void compareRoundness(vector<ObjectData> training, vector<ObjectData> testing);
-void compareHueHistograms(vector<ObjectData> training, vector<ObjectData> testing);
-void prepareImageMats(Mat &colorImage, Mat &grayImage, Mat &contourImage);
-void cleanContoursWithSigma(vector<Point> &points, double maxDistanceSigma);
-void printData(ObjectData &data);
-void calculateScore(ObjectData &data);
-void clusterHuMoments(vector<ObjectData> &data);
+void printData(const ObjectTable &table, size_t i);
+void clusterHuMoments(ObjectTable &table);
+bool dumpScores(const string &path, const ObjectTable &training, const ObjectTable &testing);
 
 int main(int argc, char **argv) {
 
+        Options options(argc, argv);
+        if (!setupMetrics(options)) {
+                exit(-1);
+        }
+
         // check argument
-        if (argc < 3) {
+        if (options.positional().size() < 2) {
                 cerr << "No enough directories given" << endl;
                 exit(-1);
         }
-        string trainingFilesPattern = string(argv[1]) + "/*.jpg";
-        string testFilesPattern = string(argv[2]) + "/*.jpg";
+        string trainingFilesPattern = options.positional()[0] + "/*.jpg";
+        string testFilesPattern = options.positional()[1] + "/*.jpg";
 
         // load file names
         vector<string> trainingFileNames, testingFileNames;
@@ -65,109 +43,67 @@ int main(int argc, char **argv) {
         glob(testFilesPattern, testingFileNames, false);
         // auto numberOfFiles = trainingFileNames.size();
 
-        // sortFiles(trainingFileNames);
-        sortFiles(testingFileNames);
+        // sortByFileNumber(trainingFileNames);
+        sortByFileNumber(testingFileNames);
 
         // cout << "Found " << numberOfFiles << " files in " << argv[1] << endl;
 
-        namedWindow("COLOR");
-        namedWindow("GRAY");
-        namedWindow("CONTOUR");
-        namedWindow("HUE");
+        // headless runs skip every window and analyze images in parallel
+        unique_ptr<ThreadPool> pool;
+        if (options.has("headless")) {
+                pool.reset(new ThreadPool(options.getInt("threads", 0)));
+        } else {
+                namedWindow("COLOR");
+                namedWindow("GRAY");
+                namedWindow("CONTOUR");
+                namedWindow("HUE");
+        }
 
-        auto trainingData = analyzeImages(trainingFileNames);
-        auto testingData = analyzeImages(testingFileNames);
+        // the printed verdict is the hue histogram gate alone, so the shape
+        // features and the roundness gate are not computed for it, unless
+        // the roundness is dumped for calibration
+        string scoresPath = options.get("dump-scores");
+        int features = scoresPath.empty() ? OBJECT_HUE_FEATURES : OBJECT_ALL_FEATURES;
+
+        // training features of unchanged files are read back from the cache
+        FeatureCache cache;
+        string cacheDirectory = options.get("feature-cache");
+        if (!cacheDirectory.empty() && !cache.open(cacheDirectory, features)) {
+                cerr << "Cannot open feature cache " << cacheDirectory << endl;
+                exit(-1);
+        }
+
+        auto trainingData = analyzeImages(trainingFileNames, pool.get(), features,
+                                          cacheDirectory.empty() ? nullptr : &cache);
+        auto testingData = analyzeImages(testingFileNames, pool.get(), features);
         // clusterHuMoments(trainingData);
-        compareRoundness(trainingData, testingData);
-        compareHueHistograms(trainingData, testingData);
+        // k-means prototypes of the training histograms, OBJECT_TYPES of them
+        // unless a count is given
+        int prototypes = 0;
+        if (options.has("prototypes")) {
+                prototypes = options.get("prototypes").empty() ? OBJECT_TYPES : options.getInt("prototypes", OBJECT_TYPES);
+        }
+        compareHueHistograms(trainingData, testingData, prototypes, !options.has("prototype-approx"),
+                             cacheDirectory.empty() ? nullptr : &cache);
+        if (!scoresPath.empty() && !dumpScores(scoresPath, trainingData, testingData)) {
+                cerr << "Cannot write scores " << scoresPath << endl;
+                exit(-1);
+        }
+
+        for (size_t i = 0; i < testingData.size(); i++) {
+                auto &fileName = testingData.fileNames[i];
+                auto fileNameOnly = fileName.substr(fileName.find_last_of('/')+1);
+                cout << fileNameOnly << "\t" << (int)(!(testingData.flags[i] & OBJECT_HUE_HIST_PASS)) << endl;
+        }
 
-        // for (auto object : testingData) {
-        //         calculateScore(object);
-        //         cout << "File: " << object.fileName << endl;
-        //         cout << "\tScore: " << object.score << endl;
+        // for (size_t i = 0; i < testingData.size(); i++) {
+        //         cout << "File: " << testingData.fileNames[i] << endl;
+        //         cout << "\tScore: " << calculateScore(testingData.flags[i]) << endl;
         // }
 
         exit(0);
 }
 
-vector<ObjectData> analyzeImages (vector<string> &fileNames) {
-        vector<ObjectData> dataBuffer;
-        for (auto file : fileNames) {
-                // cout << endl << "Analyzing file: " << file << endl;
-                Mat colorImage = imread(file.c_str(), CV_LOAD_IMAGE_COLOR);
-                Mat grayImage, contourImage;
-                ObjectData data;
-
-                data.fileName = file;
-
-                // get grayscale and contours
-                prepareImageMats(colorImage, grayImage, contourImage);
-
-                // clean from distant noise
-                vector<Point> contourPoints;
-                findNonZero(contourImage, contourPoints);
-                cleanContoursWithSigma(contourPoints, 2.0);
-
-                // limit image to the object
-                auto boundingBox = boundingRect(contourPoints);
-                colorImage = Mat(colorImage, boundingBox);
-                grayImage = Mat(grayImage, boundingBox);
-                contourImage = Mat(contourImage, boundingBox);
-
-                // calculate shape coefficients
-                vector<Point> hull;
-                convexHull(contourPoints, hull);
-                auto area = contourArea(hull);
-
-                Point2f circleCenter;
-                float circleRadius;
-                minEnclosingCircle(hull, circleCenter, circleRadius);
-                data.roundness = sqrt(area / (M_PI * pow(circleRadius, 2)));
-
-                // calculate contour moments
-
-                Moments mu = moments(contourPoints, true);
-                HuMoments(mu, data.hu);
-
-                // calculate hue histograms
-                Mat hsvImage;
-                Mat hsvPlanes[3];
-
-                cvtColor(colorImage, hsvImage, CV_BGR2HSV);
-                split(hsvImage, hsvPlanes);
-                data.hueImage = hsvPlanes[0];
-
-                int hueHistSize = HUE_HIST_BINS;
-                float range [] = {0, 180};
-                const float *hueHistRange = range;
-                calcHist(&data.hueImage, 1, 0, Mat(), data.hueHist, 1, &hueHistSize, &hueHistRange, 1, 0);
-                normalize(data.hueHist, data.hueHist, 0, 1, NORM_MINMAX, -1, Mat());
-
-                // debug print
-                imshow("COLOR", colorImage);
-                imshow("GRAY", grayImage);
-                imshow("CONTOUR", contourImage);
-                imshow("HUE", data.hueImage);
-                // printData(data);
-
-                // backlog data
-                dataBuffer.push_back(data);
-
-                // waitKey(0);
-                // break;
-        }
-        return dataBuffer;
-}
-
-void sortFiles (vector<string> &names){
-        sort (names.begin(), names.end(), [](std::string s1, std::string s2) {
-                // cout << s1.substr(s1.find_last_of("/") + 1, s1.find_last_of(".")) << endl;
-                auto number1 = std::stoi(s1.substr(s1.find_last_of("/") + 1, s1.find_last_of(".")));
-                auto number2 = std::stoi(s2.substr(s2.find_last_of("/") + 1, s2.find_last_of(".")));
-                return number1 < number2;
-        });
-}
-
 // void clusterHuMoments(vector<ObjectData> &data) {
 //         const int m = 1;
 //         vector<Point2f> hu0Samples(data.size());
@@ -192,132 +128,43 @@ void sortFiles (vector<string> &names){
 //         cout << endl;
 // }
 
-void compareRoundness(vector<ObjectData> training, vector<ObjectData> testing) {
-        // cout << "Roundness tests" << endl;
-        double minRoundness = min_element(
-                training.begin(),
-                training.end(),
-                [](ObjectData o1, ObjectData o2) {
-                return o1.roundness < o2.roundness;
-        })->roundness;
-        unsigned passed = 0;
-        unsigned failed = 0;
-
-        // cout << "\tminimal roundness found in training: " << minRoundness << endl;
-        minRoundness *= 1.0 - ROUNDNESS_LIMIT_MARGIN;
-        // cout << "\troundness lower limit for pass: " << minRoundness << endl;
-
-        for (auto object : testing) {
-                if (object.roundness > minRoundness) {
-                        passed++;
-                        object.roundnessPass = true;
-                } else {
-                        failed++;
-                        object.roundnessPass = false;
-                }
+// roundness and every training correlation of each test object, the
+// inputs of both set3 gates for ndsweep
+bool dumpScores(const string &path, const ObjectTable &training, const ObjectTable &testing) {
+        double minRoundness = training.size() ? *min_element(training.roundness.begin(), training.roundness.end()) : 0;
+        ScoreWriter scores;
+        if (!scores.open(path, SCORES_HUE, training.size(), vector<double>{HUE_HIST_MIN_CORREL}, minRoundness)) {
+                return false;
         }
 
-        // cout << "passed : " << passed << endl;
-        // cout << "failed : " << failed << endl;
-
-}
-
-void compareHueHistograms(vector<ObjectData> training, vector<ObjectData> testing) {
-        // cout << "Hue histogram tests" << endl;
-        int passed = 0;
-        int failed = 0;
-        for (auto testObject : testing) {
-                int matches = 0;
-                for (auto trainingObject : training) {
-                        auto comparisonResult = compareHist(testObject.hueHist, trainingObject.hueHist, CV_COMP_CORREL);
-                        if (comparisonResult >= HUE_HIST_MIN_CORREL) {
-                                matches++;
-                        }
+        vector<float> correlations(training.size());
+        for (size_t i = 0; i < testing.size(); i++) {
+                Mat testHist(HUE_HIST_BINS, 1, CV_32F, (void *)testing.hueHist(i));
+                for (size_t j = 0; j < training.size(); j++) {
+                        Mat trainingHist(HUE_HIST_BINS, 1, CV_32F, (void *)training.hueHist(j));
+                        correlations[j] = compareHist(testHist, trainingHist, CV_COMP_CORREL);
                 }
-                // cout << "File: " << testObject.fileName << endl;
-                // cout << "\tMatches : " << matches << endl;
-
-                if (matches >= HUE_HIST_MIN_MATCHES) {
-                        passed++;
-                        testObject.hueHistPass = true;
-                } else {
-                        failed++;
-                        testObject.hueHistPass = false;
-                }
-
-                auto fileNameOnly = testObject.fileName.substr(testObject.fileName.find_last_of('/')+1);
-                cout << fileNameOnly << "\t" << (int)(!testObject.hueHistPass) << endl;
+                auto &fileName = testing.fileNames[i];
+                scores.add(fileName.substr(fileName.find_last_of('/') + 1), testing.roundness[i], correlations.data());
         }
-
-        // cout << "passed : " << passed << endl;
-        // cout << "failed : " << failed << endl;
-}
-
-void prepareImageMats(Mat &colorImage, Mat &grayImage, Mat &contourImage) {
-        cvtColor(colorImage, grayImage, CV_BGR2GRAY);
-        blur(grayImage, grayImage, Size(BLUR_KERNEL_SIZE, BLUR_KERNEL_SIZE));
-        morphologyEx(
-                grayImage, grayImage, MORPH_CLOSE,
-                getStructuringElement(
-                        MORPH_ELLIPSE, Size(CANNY_KERNEL_SIZE + 2, CANNY_KERNEL_SIZE + 2)));
-        Canny(grayImage, contourImage, LOW_THRESHOLD, LOW_THRESHOLD * THRESH_RATIO,
-              CANNY_KERNEL_SIZE);
-}
-
-void cleanContoursWithSigma(vector<Point> &points, double maxDistanceSigma) {
-
-        // calculate mean
-        auto sum = std::accumulate(points.begin(), points.end(), Point(0, 0));
-        Point mean(sum.x / points.size(), sum.y / points.size());
-
-        // calculate distances
-        vector<double> pointDistances;
-        pointDistances.resize(points.size());
-
-        transform(points.begin(), points.end(), pointDistances.begin(),
-                  [mean](Point &p) {
-                return norm(p - mean);
-        });
-
-        // calculate standard deviation
-        double stdDev =
-                sqrt(std::accumulate(pointDistances.begin(), pointDistances.end(), 0.0,
-                                     [](double x, double y) {
-                return x + y * y;
-        }) / pointDistances.size());
-
-        // cout << "sigma = " << stdDev << endl;
-
-        // clean
-        // cout << "points before: " << points.size() << endl;
-        points.erase(remove_if(points.begin(), points.end(),
-                               [maxDistanceSigma, stdDev, mean](Point &p) {
-                return (norm(p - mean) > maxDistanceSigma * stdDev);
-        }),
-                     points.end());
-        // cout << "points after: " << points.size() << endl;
+        return scores.close();
 }
 
-void printData(ObjectData &data) {
+void printData(const ObjectTable &table, size_t i) {
         unsigned wsPad = 12;
         auto printKey = [wsPad](string key) {
                                 cout << setfill(' ') << setw(wsPad) << key << " : ";
                         };
         cout << "ObjectData fields:" << endl;
         printKey("filename");
-        cout << data.fileName << endl;
+        cout << table.fileNames[i] << endl;
         printKey("roundness");
-        cout << data.roundness << endl;
+        cout << table.roundness[i] << endl;
         printKey("hu");
         cout << "values:" << endl;
-        string huFill(' ', wsPad);
-        for (auto h : data.hu) {
+        for (int m = 0; m < HU_MOMENTS; m++) {
                 printKey("");
-                cout << h << endl;
+                cout << table.huMoments(i)[m] << endl;
         }
 }
 
-void calculateScore(ObjectData &data) {
-        data.score = WEIGHT_ROUNDNESS * (int)data.roundnessPass
-                     + WEIGHT_HUE_HIST * (int)data.hueHistPass;
-}
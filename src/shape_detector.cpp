@@ -0,0 +1,82 @@
+#include <vector>
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgproc/imgproc_c.h>
+
+#include "metrics.hpp"
+#include "scratch.hpp"
+#include "shape_detector.hpp"
+
+using namespace std;
+using namespace cv;
+
+// first external contour of the dark object into scratch.contour, false
+// when there is none
+static bool findObjectContour(const Mat &grayImage, Scratch &scratch) {
+        // invert image
+        Mat image = scratch.threshold.view(grayImage.size(), CV_8U);
+        threshold (grayImage, image, 200, 255, THRESH_BINARY_INV);
+
+        // finding contours; the C interface findContours() wraps, so they
+        // stay in the scratch's storage, reused from image to image, and
+        // only the first one, the one findContours() lists first, is copied
+        if (scratch.contourStorage.empty()) {
+                scratch.contourStorage = cvCreateMemStorage();
+        }
+        cvClearMemStorage(scratch.contourStorage);
+        CvMat header = image;
+        CvSeq *first = nullptr;
+        int found = cvFindContours(&header, scratch.contourStorage, &first, sizeof(CvContour),
+                                   CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+        ND_COUNT("contours", found);
+
+        if (!first) {
+                return false;
+        }
+
+        // cout << "\tFound " << found << (found == 1 ? " contour" : " contours - WARNING: there should be only one contour per image") << endl;
+
+        scratch.contour.resize(first->total);
+        cvCvtSeqToArray(first, scratch.contour.data());
+        return true;
+}
+
+static int approximatedSides(const vector<Point> &contour, double epsilon, vector<Point> &polygon) {
+        // counting edges
+        approxPolyDP (contour, polygon, epsilon, true);
+        return polygon.size();
+}
+
+int countPolygonSides(const Mat &grayImage, double epsilon) {
+        ND_TIMED_SCOPE("contours");
+
+        Scratch &scratch = Scratch::local();
+        int sides = -1;
+        if (findObjectContour(grayImage, scratch)) {
+                sides = approximatedSides(scratch.contour, epsilon, scratch.polygon);
+        }
+        scratch.checkpoint();
+        return sides;
+}
+
+int countPolygonSidesReduced(const Mat &grayImage, int scale) {
+        ND_TIMED_SCOPE("contours");
+
+        Scratch &scratch = Scratch::local();
+        const vector<Point> &contour = scratch.contour;
+        int sides = -1;
+        // too few pixels left to tell corners from rounding
+        double epsilon = APPROXPOLYDP_EPS / scale;
+        if (!grayImage.empty() && findObjectContour(grayImage, scratch) &&
+            arcLength(contour, true) >= REDUCED_MIN_PERIMETER_EPS * epsilon) {
+                // edges of the reduced image move by up to a pixel, the count is
+                // only trusted when a band of epsilons around the scaled one agrees
+                sides = approximatedSides(contour, epsilon, scratch.polygon);
+                if (approximatedSides(contour, epsilon * (1 - REDUCED_EPS_MARGIN), scratch.polygon) != sides ||
+                    approximatedSides(contour, epsilon * (1 + REDUCED_EPS_MARGIN), scratch.polygon) != sides) {
+                        sides = -1;
+                }
+        }
+        scratch.checkpoint();
+        return sides;
+}
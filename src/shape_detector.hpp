@@ -0,0 +1,30 @@
+#ifndef SHAPE_DETECTOR_HPP
+#define SHAPE_DETECTOR_HPP
+
+#include <opencv2/core/core.hpp>
+
+// minimum safe value times 2
+const double APPROXPOLYDP_EPS = 20.0;
+
+// relative band of epsilons that must agree on a reduced side count
+const double REDUCED_EPS_MARGIN = 0.25;
+
+// smallest reduced contour, in epsilons of perimeter, worth approximating
+const double REDUCED_MIN_PERIMETER_EPS = 8.0;
+
+// Number of sides of the polygon approximating the first external contour
+// of a grayscale image, or -1 when there is no contour.
+int countPolygonSides(const cv::Mat &grayImage, double epsilon = APPROXPOLYDP_EPS);
+
+// The same count on an image reduced by scale, with the epsilon scaled to
+// match, or -1 when it is ambiguous there: no contour, a contour too small
+// for its corners to survive, or a count that changes within
+// REDUCED_EPS_MARGIN of the epsilon. Callers fall back to full resolution.
+int countPolygonSidesReduced(const cv::Mat &grayImage, int scale);
+
+// 0 for triangles and quadrilaterals, 1 for anything else
+inline int shapeVerdict(int numberOfSides) {
+        return (int) (!(numberOfSides == 3 or numberOfSides == 4));
+}
+
+#endif
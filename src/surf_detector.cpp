@@ -0,0 +1,412 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "flann_tuning.hpp"
+#include "frame.hpp"
+#include "hsv_tables.hpp"
+#include "metrics.hpp"
+#include "surf_detector.hpp"
+#include "training.hpp"
+
+using namespace std;
+using namespace cv;
+
+// The red test reduced to table lookups. A pixel's hue only depends on
+// which channel is the largest, the difference of the other two and
+// diff = max - min, and is monotonic in that difference. So per diff,
+// the red hues of each branch are an interval of differences, and the
+// saturation and value limits are a minimum diff per max channel value.
+struct RedGate {
+        // smallest diff passing saturation and value, 256 when none does
+        short minDiff[256];
+        // per max channel (r, g, b) and diff, the red range of differences
+        short low[3][256];
+        short high[3][256];
+};
+
+static bool isRedHue(int h) {
+        return h <= RED_HUE_LOW_MAX || h >= RED_HUE_HIGH_MIN;
+}
+
+static RedGate buildRedGate() {
+        const HsvTables &tables = hsvTables();
+        RedGate gate;
+
+        for (int v = 0; v < 256; v++) {
+                int diff = 0;
+                while (diff <= v && hsvSaturation(tables, v, diff) < RED_MIN_SATURATION) {
+                        diff++;
+                }
+                gate.minDiff[v] = (v >= RED_MIN_VALUE && diff <= v) ? diff : 256;
+        }
+
+        for (int diff = 0; diff < 256; diff++) {
+                for (int branch = 0; branch < 3; branch++) {
+                        gate.low[branch][diff] = 1;
+                        gate.high[branch][diff] = 0;
+                }
+                if (diff == 0) {
+                        continue;
+                }
+                for (int offset = -diff; offset <= diff; offset++) {
+                        for (int branch = 0; branch < 3; branch++) {
+                                if (!isRedHue(hsvHue(tables, branch, offset, diff))) {
+                                        continue;
+                                }
+                                if (gate.low[branch][diff] > gate.high[branch][diff]) {
+                                        gate.low[branch][diff] = offset;
+                                }
+                                gate.high[branch][diff] = offset;
+                        }
+                }
+        }
+        return gate;
+}
+
+int countRedPixels(const Mat &bgr, int stopAbove) {
+        CV_Assert(bgr.type() == CV_8UC3);
+        ND_TIMED_SCOPE("red_pixels");
+        static const RedGate gate = buildRedGate();
+
+        // one pass over the pixels, no HSV image or masks in between
+        int count = 0;
+        for (int y = 0; y < bgr.rows && count <= stopAbove; y++) {
+                const uchar *pixel = bgr.ptr<uchar>(y);
+                for (int x = 0; x < bgr.cols; x++, pixel += 3) {
+                        int b = pixel[0], g = pixel[1], r = pixel[2];
+                        int v = max(b, max(g, r));
+                        int diff = v - min(b, min(g, r));
+                        if (diff < gate.minDiff[v]) {
+                                continue;
+                        }
+                        int offset;
+                        int branch = hsvBranch(b, g, r, v, offset);
+                        count += offset >= gate.low[branch][diff] && offset <= gate.high[branch][diff];
+                }
+        }
+        return count;
+}
+
+int acceptableMatch(const string &backend) {
+        if (backend == "orb") {
+                return ACCEPTABLE_MATCH_ORB;
+        }
+        if (backend == "brisk") {
+                return ACCEPTABLE_MATCH_BRISK;
+        }
+        return ACCEPTABLE_MATCH;
+}
+
+int surfVerdict(int largestNumOfMatches, int redPixels, int acceptable) {
+        if (largestNumOfMatches >= acceptable &&
+            redPixels >= NON_BLACK_MIN &&
+            redPixels <= NON_BLACK_MAX) {
+                return 0;
+        }
+        return 1;
+}
+
+void addSurfGates(GateCascade<Frame> &cascade, const FeatureMatcher &matcher, int acceptable) {
+        // counting stops past the upper limit, that count fails as well
+        cascade.add("red_pixels", [](Frame &frame) {
+                int redPixels = countRedPixels(frame.bgr());
+                return redPixels >= NON_BLACK_MIN && redPixels <= NON_BLACK_MAX;
+        });
+        cascade.add("features", [&matcher, acceptable](Frame &frame) {
+                Mat descriptors;
+                matcher.computeDescriptors(frame.gray(), descriptors);
+                return matcher.matchesAny(descriptors, acceptable);
+        });
+}
+
+bool parseFeatureModelParams(const Options &options, FeatureModelParams &params) {
+        params.backend = options.get("features", defaultFeatureBackend());
+        params.keypointBudget = options.getInt("max-keypoints", 0);
+        params.pcaDims = options.getInt("pca", 0);
+        params.quantization = quantizationByName(options.get("quantize", "none"));
+
+        if (params.keypointBudget < 0 || params.pcaDims < 0) {
+                cerr << "--max-keypoints and --pca take a positive count" << endl;
+                return false;
+        }
+        if (params.quantization < 0) {
+                cerr << "Unknown quantization " << options.get("quantize") << ", expected none, int8 or fp16" << endl;
+                return false;
+        }
+
+        if (options.has("tune-flann")) {
+                params.flannRecall = options.get("tune-flann").empty()
+                                     ? FLANN_RECALL_TARGET : options.getDouble("tune-flann", FLANN_RECALL_TARGET);
+                if (params.flannRecall <= 0 || params.flannRecall > 1) {
+                        cerr << "--tune-flann takes a recall target in (0, 1]" << endl;
+                        return false;
+                }
+                // compressed descriptors are not matched through FLANN pairs
+                if (params.pcaDims > 0 || params.quantization != QUANTIZE_NONE) {
+                        cerr << "--tune-flann applies to uncompressed descriptors, not with --pca or --quantize" << endl;
+                        return false;
+                }
+        }
+        return true;
+}
+
+static vector<char> int32Section(int32_t value) {
+        return vector<char>((const char *)&value, (const char *)(&value + 1));
+}
+
+static void addFeatureSections(DescriptorModelWriter &writer, const FeatureModelParams &params) {
+        writer.addSection(MODEL_SECTION_FEATURES, vector<char>(params.backend.begin(), params.backend.end()));
+        writer.addSection(MODEL_SECTION_KEYPOINT_BUDGET, int32Section(params.keypointBudget));
+}
+
+static size_t fileSize(const string &path) {
+        ifstream file(path.c_str(), ios::binary | ios::ate);
+        return file.is_open() ? (size_t)file.tellg() : 0;
+}
+
+// match counts of consecutive training images, exact float descriptors
+// against their compact form, so the cost of compression is visible
+static void reportCompression(const DescriptorModel &raw, const DescriptorCodec &codec,
+                              const string &rawPath, const string &modelPath) {
+        long exactTotal = 0, compactTotal = 0, absoluteDifference = 0;
+        int pairs = 0;
+        for (size_t i = 0; i + 1 < raw.size() && pairs < COMPRESSION_REPORT_PAIRS; i++, pairs++) {
+                Mat query, train;
+                codec.encode(raw.descriptors(i), query);
+                codec.encode(raw.descriptors(i + 1), train);
+                int exact = countGoodMatchesExact(raw.descriptors(i), raw.descriptors(i + 1), DIST_COEFF);
+                int compact = codec.countGoodMatches(query, train, DIST_COEFF);
+                exactTotal += exact;
+                compactTotal += compact;
+                absoluteDifference += abs(exact - compact);
+        }
+
+        cerr << "Compressed model " << fileSize(rawPath) << " -> " << fileSize(modelPath) << " bytes, "
+             << raw.cols() << " -> " << codec.dims() << " dims";
+        if (pairs > 0) {
+                cerr << ", good matches over " << pairs << " training pairs " << exactTotal << " -> " << compactTotal
+                     << " (mean absolute change " << (double)absoluteDifference / pairs << ")";
+        }
+        cerr << endl;
+}
+
+// descriptors querying the model during FLANN tuning: a spread sample of
+// the given images extracted like test images, or else the training
+// images, each kept away from its own descriptors
+static void tuningQueries(const DescriptorModel &raw, const FeatureModelParams &params,
+                          vector<Mat> &queries, vector<int> &excluded) {
+        if (params.tuningQueries.empty()) {
+                for (size_t i = 0; i < raw.size(); i++) {
+                        queries.push_back(raw.descriptors(i));
+                        excluded.push_back((int)i);
+                }
+                return;
+        }
+
+        FeatureExtractor extractor;
+        extractor.create(params.backend);
+        extractor.setKeypointBudget(params.keypointBudget);
+        size_t step = max<size_t>(1, params.tuningQueries.size() / FLANN_TUNING_QUERIES);
+        for (size_t i = 0; i < params.tuningQueries.size(); i += step) {
+                Frame frame;
+                if (!frame.load(params.tuningQueries[i], FRAME_GRAY)) {
+                        continue;
+                }
+                vector<KeyPoint> keypoints;
+                Mat descriptors;
+                extractor.compute(frame.gray(), keypoints, descriptors);
+                queries.push_back(descriptors);
+                excluded.push_back(-1);
+        }
+}
+
+bool trainFeatureModel(const vector<string> &fileNames, const string &modelPath,
+                       const FeatureModelParams &params, int workers) {
+        bool compress = params.pcaDims > 0 || params.quantization != QUANTIZE_NONE;
+        bool tune = params.flannRecall > 0;
+        // a compressed or tuned model is derived from the extracted one,
+        // written aside first
+        string rawPath = compress || tune ? modelPath + ".raw" : modelPath;
+
+        DescriptorModelWriter writer;
+        if (!writer.open(rawPath)) {
+                return false;
+        }
+        if (!extractTrainingModel(fileNames, writer, params.backend, params.keypointBudget, workers)) {
+                cerr << "Feature backend " << params.backend << " is not available" << endl;
+                return false;
+        }
+        addFeatureSections(writer, params);
+        if (!writer.close()) {
+                return false;
+        }
+        if (!compress && !tune) {
+                return true;
+        }
+
+        DescriptorModel raw;
+        if (!raw.open(rawPath)) {
+                return false;
+        }
+        if (raw.totalRows() == 0) {
+                cerr << "No training descriptors to " << (compress ? "fit the compression" : "tune FLANN") << " on" << endl;
+                return false;
+        }
+        if (raw.type() != CV_32F) {
+                cerr << (compress ? "Compression" : "FLANN tuning") << " needs float descriptors, "
+                     << params.backend << " gives binary ones" << endl;
+                return false;
+        }
+
+        DescriptorCodec codec;
+        if (compress) {
+                codec.fit(raw.all(), params.pcaDims, params.quantization);
+        }
+
+        FlannConfig flannConfig;
+        if (tune) {
+                vector<Mat> queries;
+                vector<int> excluded;
+                tuningQueries(raw, params, queries, excluded);
+                flannConfig = tuneFlann(raw, queries, excluded, DIST_COEFF, params.flannRecall, cerr);
+        }
+
+        DescriptorModelWriter rewritten;
+        if (!rewritten.open(modelPath)) {
+                return false;
+        }
+        Mat encoded;
+        for (size_t i = 0; i < raw.size(); i++) {
+                if (compress) {
+                        codec.encode(raw.descriptors(i), encoded);
+                        rewritten.add(encoded);
+                } else {
+                        rewritten.add(raw.descriptors(i));
+                }
+        }
+        addFeatureSections(rewritten, params);
+        if (compress) {
+                rewritten.addSection(MODEL_SECTION_CODEC, codec.serialize());
+        }
+        if (tune) {
+                rewritten.addSection(MODEL_SECTION_FLANN, flannConfig.serialize());
+        }
+        if (!rewritten.close()) {
+                return false;
+        }
+
+        if (compress) {
+                reportCompression(raw, codec, rawPath, modelPath);
+        }
+        raw.close();
+        remove(rawPath.c_str());
+        return true;
+}
+
+bool FeatureMatcher::open(const string &modelPath, bool useGlobalIndex) {
+        // map the model, descriptors are used in place
+        if (!model.open(modelPath)) {
+                return false;
+        }
+
+        // models written before the backend was recorded are SURF ones
+        const char *name;
+        size_t length;
+        string backend = model.section(MODEL_SECTION_FEATURES, name, length) ? string(name, length) : "surf";
+        if (!extractor.create(backend)) {
+                cerr << "Feature backend " << backend << " of " << modelPath << " is not available" << endl;
+                return false;
+        }
+
+        const char *data;
+        if (model.section(MODEL_SECTION_KEYPOINT_BUDGET, data, length) && length == sizeof(int32_t)) {
+                int32_t budget;
+                memcpy(&budget, data, sizeof(budget));
+                extractor.setKeypointBudget(budget);
+        }
+
+        codec = DescriptorCodec();
+        if (model.section(MODEL_SECTION_CODEC, data, length) && !codec.deserialize(data, length)) {
+                cerr << "Invalid descriptor codec in " << modelPath << endl;
+                return false;
+        }
+
+        // models written without tuning keep the FlannBasedMatcher defaults
+        flannConfig = FlannConfig();
+        if (model.section(MODEL_SECTION_FLANN, data, length) && !flannConfig.deserialize(data, length)) {
+                cerr << "Invalid FLANN configuration in " << modelPath << endl;
+                return false;
+        }
+
+        // single index over every training descriptor instead of one per
+        // pair; the KD-trees of a compressed model index its decoded rows
+        Mat rows;
+        if (useGlobalIndex && codec.enabled()) {
+                codec.decode(model.all(), rows);
+        }
+        globalIndex.reset(useGlobalIndex ? new GlobalIndex(model, rows, flannConfig) : nullptr);
+        return true;
+}
+
+void FeatureMatcher::computeDescriptors(const Mat &grayImage, Mat &descriptors) const {
+        vector<KeyPoint> keypoints;
+        extractor.compute(grayImage, keypoints, descriptors);
+        if (codec.enabled()) {
+                Mat encoded;
+                codec.encode(descriptors, encoded);
+                descriptors = encoded;
+        }
+}
+
+void FeatureMatcher::countMatches(const Mat &descriptors, vector<int> &matchesCount, double distCoeff) const {
+        ND_TIMED_SCOPE("matching");
+
+        if (globalIndex) {
+                // one query against the index over all training images
+                Mat query = descriptors;
+                if (codec.enabled()) {
+                        codec.decode(descriptors, query);
+                }
+                globalIndex->vote(query, distCoeff, matchesCount);
+                return;
+        }
+
+        // compare against every training image, compact rows directly
+        matchesCount.clear();
+        for (size_t i = 0; i < model.size(); i++) {
+                matchesCount.push_back(codec.enabled()
+                                       ? codec.countGoodMatches(descriptors, model.descriptors(i), distCoeff)
+                                       : countGoodMatches(descriptors, model.descriptors(i), distCoeff, flannConfig));
+        }
+}
+
+bool FeatureMatcher::matchesAny(const Mat &descriptors, int acceptable) const {
+        // an empty model counts as zero matches, as in surfVerdict()
+        if (acceptable <= 0) {
+                return true;
+        }
+
+        if (globalIndex) {
+                // a single vote gives every count at once
+                vector<int> matchesCount;
+                countMatches(descriptors, matchesCount);
+                return !matchesCount.empty() && *max_element(matchesCount.begin(), matchesCount.end()) >= acceptable;
+        }
+
+        ND_TIMED_SCOPE("matching");
+        for (size_t i = 0; i < model.size(); i++) {
+                int matches = codec.enabled()
+                              ? codec.countGoodMatches(descriptors, model.descriptors(i), DIST_COEFF)
+                              : countGoodMatches(descriptors, model.descriptors(i), DIST_COEFF, flannConfig);
+                if (matches >= acceptable) {
+                        ND_COUNT("matching_early_exits", 1);
+                        return true;
+                }
+        }
+        return false;
+}
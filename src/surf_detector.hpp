@@ -0,0 +1,126 @@
+#ifndef SURF_DETECTOR_HPP
+#define SURF_DETECTOR_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "cascade.hpp"
+#include "descriptor_codec.hpp"
+#include "descriptor_model.hpp"
+#include "features.hpp"
+#include "frame.hpp"
+#include "matching.hpp"
+#include "options.hpp"
+
+// acceptable value of matches, determined by trial and error
+const int ACCEPTABLE_MATCH = 52;
+
+// the same for the binary backends, a starting point to be tuned with
+// --acceptable-match against the data set
+const int ACCEPTABLE_MATCH_ORB = 40;
+const int ACCEPTABLE_MATCH_BRISK = 40;
+
+// model section holding the name of the feature backend it was built with
+const uint32_t MODEL_SECTION_FEATURES = modelTag('F', 'E', 'A', 'T');
+
+// model section holding the keypoint budget as an int32, applied to test
+// images too so both sides keep the same strongest keypoints
+const uint32_t MODEL_SECTION_KEYPOINT_BUDGET = modelTag('K', 'B', 'U', 'D');
+
+// training pairs whose match counts are compared before and after compression
+const int COMPRESSION_REPORT_PAIRS = 32;
+
+// determine min hessian value
+const int MIN_HESSIAN = 1000;
+
+// distance coefficient, determined by trial and error
+const double DIST_COEFF = 0.7;
+
+// max and min values of non black pixels, determined by trial and error
+const int NON_BLACK_MAX = 3562;
+const int NON_BLACK_MIN = 85;
+
+// HSV ranges counted as red, hue in [0, 10] or [120, 180]
+const int RED_HUE_LOW_MAX = 10;
+const int RED_HUE_HIGH_MIN = 120;
+const int RED_MIN_SATURATION = 70;
+const int RED_MIN_VALUE = 50;
+
+// number of pixels of a BGR image falling into the red HSV ranges, the
+// same count as cvtColor() and inRange() would give. Counting stops once
+// it exceeds stopAbove, the partial count is returned then.
+int countRedPixels(const cv::Mat &bgr, int stopAbove = NON_BLACK_MAX);
+
+// default acceptable match count of a feature backend
+int acceptableMatch(const std::string &backend);
+
+// 0 when the test image matched some training image well enough and has
+// a plausible amount of red, 1 otherwise
+int surfVerdict(int largestNumOfMatches, int redPixels, int acceptable = ACCEPTABLE_MATCH);
+
+// how training images are turned into a descriptor model
+struct FeatureModelParams {
+        std::string backend;
+        // strongest keypoints kept per image, 0 keeps all
+        int keypointBudget = 0;
+        // PCA dimensions of float descriptors, 0 keeps every dimension
+        int pcaDims = 0;
+        int quantization = QUANTIZE_NONE;
+        // recall target of FLANN tuning, 0 keeps the default configuration
+        double flannRecall = 0;
+        // images whose descriptors query the model during tuning, the
+        // training images themselves when empty
+        std::vector<std::string> tuningQueries;
+};
+
+// reads --features, --max-keypoints, --pca, --quantize and --tune-flann,
+// false with a message on stderr when one of them is invalid
+bool parseFeatureModelParams(const Options &options, FeatureModelParams &params);
+
+class FeatureMatcher;
+
+// the two gates of surfVerdict(), the red pixel count of the BGR view and
+// the feature match of the gray view, for a cascade giving the same
+// verdicts without computing every count
+void addSurfGates(GateCascade<Frame> &cascade, const FeatureMatcher &matcher, int acceptable);
+
+// extracts the descriptors of every training image into a model file,
+// compressed when the params ask for PCA or quantization, with a tuned
+// FLANN configuration when they ask for tuning
+bool trainFeatureModel(const std::vector<std::string> &fileNames, const std::string &modelPath,
+                       const FeatureModelParams &params, int workers);
+
+// Matching side of the feature check, over a mapped descriptor model and
+// optionally a global index built on it. Descriptors of test images are
+// extracted with the backend and keypoint budget the model was trained
+// with, and compressed by its codec when it has one. All methods are
+// safe to call from several threads at once.
+class FeatureMatcher {
+public:
+        bool open(const std::string &modelPath, bool useGlobalIndex);
+
+        size_t size() const { return model.size(); }
+        const std::string &backend() const { return extractor.backend(); }
+
+        void computeDescriptors(const cv::Mat &grayImage, cv::Mat &descriptors) const;
+
+        // good match count against every training image
+        void countMatches(const cv::Mat &descriptors, std::vector<int> &matchesCount,
+                          double distCoeff = DIST_COEFF) const;
+
+        // whether some training image has at least acceptable good matches,
+        // the scan stops at the first one that does
+        bool matchesAny(const cv::Mat &descriptors, int acceptable) const;
+
+private:
+        DescriptorModel model;
+        FeatureExtractor extractor;
+        DescriptorCodec codec;
+        FlannConfig flannConfig;
+        std::unique_ptr<GlobalIndex> globalIndex;
+};
+
+#endif
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "options.hpp"
+#include "score_file.hpp"
+
+using namespace std;
+
+// Sweeps the decision thresholds of set2 or set3 over a score dump written
+// with --dump-scores and reports the precision and recall of every
+// combination against a labels file. Novel images (label 1) are the
+// positive class. Every image is reduced to a few numbers first, so each
+// combination costs one comparison per image.
+
+typedef chrono::steady_clock Clock;
+
+// a threshold range "first:last:step", or a single value
+static bool parseRange(const string &text, vector<double> &values) {
+        values.clear();
+        double first, last, step;
+        char colon1, colon2;
+        istringstream range(text);
+        if (range >> first >> colon1 >> last >> colon2 >> step && colon1 == ':' && colon2 == ':'
+            && step > 0 && last >= first) {
+                // a small tolerance keeps the last value despite rounding
+                for (int i = 0; first + i * step <= last + step * 1e-6; i++) {
+                        values.push_back(first + i * step);
+                }
+                return true;
+        }
+        istringstream single(text);
+        if (single >> first && single.eof()) {
+                values.push_back(first);
+                return true;
+        }
+        return false;
+}
+
+static vector<double> rangeOption(const Options &options, const string &name, const string &fallback) {
+        vector<double> values;
+        string text = options.get(name);
+        if (!parseRange(text.empty() ? fallback : text, values)) {
+                cerr << "Invalid range for --" << name << ": " << options.get(name) << ", expected first:last:step" << endl;
+                exit(-1);
+        }
+        return values;
+}
+
+// "<name>\t<label>" lines, as in responses.txt
+static bool readLabels(const string &path, map<string, int> &labels) {
+        ifstream file(path.c_str());
+        if (!file.is_open()) {
+                return false;
+        }
+        string name;
+        int label;
+        while (file >> name >> label) {
+                labels[name] = label;
+        }
+        return true;
+}
+
+struct Counts {
+        int truePositives = 0;
+        int falsePositives = 0;
+        int falseNegatives = 0;
+        int trueNegatives = 0;
+
+        void add(bool novel, bool predictedNovel) {
+                if (predictedNovel) {
+                        (novel ? truePositives : falsePositives)++;
+                } else {
+                        (novel ? falseNegatives : trueNegatives)++;
+                }
+        }
+
+        double precision() const {
+                return truePositives + falsePositives ? (double)truePositives / (truePositives + falsePositives) : 1.0;
+        }
+        double recall() const {
+                return truePositives + falseNegatives ? (double)truePositives / (truePositives + falseNegatives) : 1.0;
+        }
+        double f1() const {
+                double p = precision(), r = recall();
+                return p + r > 0 ? 2 * p * r / (p + r) : 0.0;
+        }
+};
+
+// one output row per combination, the best F1 kept for the summary
+class Report {
+public:
+        explicit Report(const string &parameters) : start(Clock::now()) {
+                cout << parameters << "\ttp\tfp\tfn\ttn\tprecision\trecall\tf1" << endl;
+        }
+
+        void add(const string &parameters, const Counts &counts) {
+                cout << parameters << "\t" << counts.truePositives << "\t" << counts.falsePositives
+                     << "\t" << counts.falseNegatives << "\t" << counts.trueNegatives
+                     << "\t" << counts.precision() << "\t" << counts.recall() << "\t" << counts.f1() << "\n";
+                combinations++;
+                if (counts.f1() > bestF1) {
+                        bestF1 = counts.f1();
+                        best = parameters;
+                        replace(best.begin(), best.end(), '\t', ' ');
+                }
+        }
+
+        void summary() const {
+                double milliseconds = chrono::duration<double, milli>(Clock::now() - start).count();
+                cerr << combinations << " combinations in " << milliseconds << " ms, best f1 " << bestF1
+                     << " at " << best << endl;
+        }
+
+private:
+        Clock::time_point start;
+        long combinations = 0;
+        double bestF1 = -1;
+        string best;
+};
+
+// set2: novel unless the best training image has enough good matches at
+// the distance coefficient and the red count is within its limits
+static void sweepFeatures(const ScoreSet &scores, const vector<int> &labels, const Options &options) {
+        vector<double> acceptable = rangeOption(options, "acceptable-match", "20:100:4");
+        vector<double> redMin = rangeOption(options, "red-min", "0:200:25");
+        vector<double> redMax = rangeOption(options, "red-max", "2000:5000:500");
+
+        // best match count per image and distance coefficient level
+        size_t levels = scores.levels.size();
+        vector<float> largest(scores.size() * levels, 0.f);
+        for (size_t i = 0; i < scores.size(); i++) {
+                for (size_t level = 0; level < levels; level++) {
+                        const float *counts = scores.scores(i, level);
+                        if (scores.trainingCount) {
+                                largest[i * levels + level] = *max_element(counts, counts + scores.trainingCount);
+                        }
+                }
+        }
+
+        Report report("dist_coeff\tacceptable_match\tred_min\tred_max");
+        for (size_t level = 0; level < levels; level++) {
+                for (double minMatches : acceptable) {
+                        for (double low : redMin) {
+                                for (double high : redMax) {
+                                        Counts counts;
+                                        for (size_t i = 0; i < scores.size(); i++) {
+                                                if (labels[i] < 0) {
+                                                        continue;
+                                                }
+                                                double red = scores.scalars[i];
+                                                bool known = largest[i * levels + level] >= minMatches && red >= low && red <= high;
+                                                counts.add(labels[i] == 1, !known);
+                                        }
+                                        ostringstream parameters;
+                                        parameters << scores.levels[level] << "\t" << minMatches << "\t" << low << "\t" << high;
+                                        report.add(parameters.str(), counts);
+                                }
+                        }
+                }
+        }
+        report.summary();
+}
+
+// set3: novel unless at least min matches training histograms correlate
+// by min correl, and with --roundness-margin unless the roundness passes
+static void sweepHue(const ScoreSet &scores, const vector<int> &labels, const Options &options) {
+        vector<double> minCorrel = rangeOption(options, "min-correl", "0.5:0.99:0.01");
+        vector<double> minMatches = rangeOption(options, "min-matches", "1:20:1");
+        // without the option the roundness gate is left out, as in the set3 verdict
+        bool roundness = options.has("roundness-margin");
+        vector<double> margins = roundness ? rangeOption(options, "roundness-margin", "0:0.3:0.02") : vector<double>{0};
+
+        // correlations sorted from the best, so n matches at a threshold
+        // means the n-th best reaches it
+        vector<float> sorted(scores.values);
+        for (size_t i = 0; i < scores.size(); i++) {
+                float *correlations = &sorted[i * scores.trainingCount];
+                sort(correlations, correlations + scores.trainingCount, greater<float>());
+        }
+
+        Report report("min_correl\tmin_matches\troundness_margin");
+        for (double correl : minCorrel) {
+                // compared in float, as the verdicts do
+                float threshold = (float)correl;
+                for (double matches : minMatches) {
+                        size_t n = (size_t)max(1.0, matches);
+                        for (double margin : margins) {
+                                double minRoundness = scores.reference * (1.0 - margin);
+                                Counts counts;
+                                for (size_t i = 0; i < scores.size(); i++) {
+                                        if (labels[i] < 0) {
+                                                continue;
+                                        }
+                                        bool known = n <= scores.trainingCount
+                                                     && sorted[i * scores.trainingCount + n - 1] >= threshold
+                                                     && (!roundness || scores.scalars[i] > minRoundness);
+                                        counts.add(labels[i] == 1, !known);
+                                }
+                                ostringstream parameters;
+                                parameters << correl << "\t" << n << "\t";
+                                if (roundness) {
+                                        parameters << margin;
+                                } else {
+                                        parameters << "-";
+                                }
+                                report.add(parameters.str(), counts);
+                        }
+                }
+        }
+        report.summary();
+}
+
+int main(int argc, char **argv) {
+        Options options(argc, argv);
+        if (options.positional().size() < 2) {
+                cerr << "Usage: ndsweep <scores> <labels> [--acceptable-match=<range>] [--red-min=<range>]"
+                     << " [--red-max=<range>] [--min-correl=<range>] [--min-matches=<range>]"
+                     << " [--roundness-margin=<range>]" << endl;
+                exit(-1);
+        }
+
+        ScoreSet scores;
+        if (!readScores(options.positional()[0], scores)) {
+                cerr << "Cannot read scores " << options.positional()[0] << endl;
+                exit(-1);
+        }
+        map<string, int> labelsByName;
+        if (!readLabels(options.positional()[1], labelsByName)) {
+                cerr << "Cannot read labels " << options.positional()[1] << endl;
+                exit(-1);
+        }
+
+        // images without a label are left out of every count
+        vector<int> labels(scores.size(), -1);
+        size_t unlabeled = 0;
+        for (size_t i = 0; i < scores.size(); i++) {
+                auto label = labelsByName.find(scores.names[i]);
+                if (label == labelsByName.end()) {
+                        unlabeled++;
+                        continue;
+                }
+                labels[i] = label->second;
+        }
+        cerr << scores.size() << " images against " << scores.trainingCount << " training images";
+        if (unlabeled) {
+                cerr << ", " << unlabeled << " without a label";
+        }
+        cerr << endl;
+
+        if (scores.kind == SCORES_FEATURES) {
+                sweepFeatures(scores, labels, options);
+        } else if (scores.kind == SCORES_HUE) {
+                sweepHue(scores, labels, options);
+        } else {
+                cerr << "Unknown score kind " << scores.kind << endl;
+                exit(-1);
+        }
+        return 0;
+}
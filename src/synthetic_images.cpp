@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "synthetic_images.hpp"
+
+using namespace std;
+using namespace cv;
+
+static const char *SHAPE_NAMES[SYNTHETIC_SHAPES] = {"triangle", "quad", "round", "red"};
+
+// background level and noise, above set1's binarization threshold of 200
+const int BACKGROUND_LEVEL = 235;
+const int BACKGROUND_NOISE = 8;
+
+// object size as a fraction of the smaller image side
+const double MIN_OBJECT_SCALE = 0.2;
+const double MAX_OBJECT_SCALE = 0.4;
+
+// texture strokes drawn over red objects, SURF needs something to find
+const int TEXTURE_STROKES = 24;
+
+int syntheticShapeByName(const string &name) {
+        for (int shape = 0; shape < SYNTHETIC_SHAPES; shape++) {
+                if (name == SHAPE_NAMES[shape]) {
+                        return shape;
+                }
+        }
+        return -1;
+}
+
+const char *syntheticShapeName(int shape) {
+        return shape >= 0 && shape < SYNTHETIC_SHAPES ? SHAPE_NAMES[shape] : "";
+}
+
+// corners of a regular polygon, rotated and slightly jittered
+static vector<Point> polygonCorners(int corners, Point2f center, float radius, RNG &rng) {
+        vector<Point> points;
+        double rotation = rng.uniform(0., 2 * M_PI);
+        for (int i = 0; i < corners; i++) {
+                double angle = rotation + 2 * M_PI * i / corners;
+                float jitter = radius * rng.uniform(0.85f, 1.0f);
+                points.push_back(Point(center.x + jitter * cos(angle), center.y + jitter * sin(angle)));
+        }
+        return points;
+}
+
+Mat drawSyntheticImage(int shape, Size size, RNG &rng) {
+        Mat image(size, CV_8UC3, Scalar::all(BACKGROUND_LEVEL));
+        Mat noise(size, CV_8UC3);
+        rng.fill(noise, RNG::UNIFORM, Scalar::all(0), Scalar::all(BACKGROUND_NOISE));
+        image -= noise;
+
+        float side = min(size.width, size.height);
+        float radius = side * rng.uniform(MIN_OBJECT_SCALE, MAX_OBJECT_SCALE);
+        Point2f center(rng.uniform(radius, size.width - radius), rng.uniform(radius, size.height - radius));
+
+        switch (shape) {
+        case SYNTHETIC_TRIANGLE:
+        case SYNTHETIC_QUAD: {
+                vector<Point> corners = polygonCorners(shape == SYNTHETIC_TRIANGLE ? 3 : 4, center, radius, rng);
+                int level = rng.uniform(0, 120);
+                fillConvexPoly(image, &corners[0], corners.size(), Scalar::all(level), CV_AA);
+                break;
+        }
+        case SYNTHETIC_ROUND: {
+                // hues away from red, in OpenCV's 0-180 range
+                Mat hsv(1, 1, CV_8UC3, Scalar(rng.uniform(20, 110), rng.uniform(120, 256), rng.uniform(120, 256)));
+                Mat bgr;
+                cvtColor(hsv, bgr, CV_HSV2BGR);
+                Vec3b color = bgr.at<Vec3b>(0, 0);
+                Size2f axes(2 * radius, 2 * radius * rng.uniform(0.8f, 1.0f));
+                ellipse(image, RotatedRect(center, axes, rng.uniform(0.f, 180.f)),
+                        Scalar(color[0], color[1], color[2]), -1, CV_AA);
+                break;
+        }
+        default: {
+                vector<Point> corners = polygonCorners(rng.uniform(5, 9), center, radius, rng);
+                fillConvexPoly(image, &corners[0], corners.size(), Scalar(rng.uniform(0, 40), rng.uniform(0, 40), rng.uniform(150, 256)), CV_AA);
+                for (int i = 0; i < TEXTURE_STROKES; i++) {
+                        Point from(center.x + rng.uniform(-radius, radius) / 2, center.y + rng.uniform(-radius, radius) / 2);
+                        Point to(center.x + rng.uniform(-radius, radius) / 2, center.y + rng.uniform(-radius, radius) / 2);
+                        line(image, from, to, Scalar::all(rng.uniform(0, 256)), rng.uniform(1, 4), CV_AA);
+                }
+                break;
+        }
+        }
+        return image;
+}
+
+vector<SyntheticImage> generateSyntheticImages(const vector<int> &shapes, int count, Size size, unsigned seed) {
+        vector<SyntheticImage> images;
+        if (shapes.empty()) {
+                return images;
+        }
+
+        RNG rng(seed);
+        for (int i = 0; i < count; i++) {
+                SyntheticImage synthetic;
+                synthetic.shape = shapes[i % shapes.size()];
+                synthetic.image = drawSyntheticImage(synthetic.shape, size, rng);
+                images.push_back(synthetic);
+        }
+        return images;
+}
+
+bool writeSyntheticImages(const vector<SyntheticImage> &images, const string &dir) {
+        for (size_t i = 0; i < images.size(); i++) {
+                if (!imwrite(dir + "/" + to_string(i) + ".jpg", images[i].image)) {
+                        return false;
+                }
+        }
+        return true;
+}
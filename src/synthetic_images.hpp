@@ -0,0 +1,41 @@
+#ifndef SYNTHETIC_IMAGES_HPP
+#define SYNTHETIC_IMAGES_HPP
+
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+// kinds of objects the generator draws
+enum SyntheticShape {
+        SYNTHETIC_TRIANGLE = 0,
+        SYNTHETIC_QUAD = 1,
+        SYNTHETIC_ROUND = 2,
+        SYNTHETIC_RED = 3,
+        SYNTHETIC_SHAPES = 4
+};
+
+// "triangle", "quad", "round" or "red", -1 for anything else
+int syntheticShapeByName(const std::string &name);
+const char *syntheticShapeName(int shape);
+
+struct SyntheticImage {
+        int shape;
+        cv::Mat image;
+};
+
+// One object on a light, slightly noisy background: dark triangles and
+// quadrilaterals like set1's, colored round objects like set3's and
+// textured red objects for set2's color gate and SURF. Placement, size,
+// rotation and color are drawn from rng, so a seed always reproduces the
+// same image.
+cv::Mat drawSyntheticImage(int shape, cv::Size size, cv::RNG &rng);
+
+// count images cycling through the given shapes, same seed same images
+std::vector<SyntheticImage> generateSyntheticImages(const std::vector<int> &shapes, int count,
+                                                    cv::Size size, unsigned seed);
+
+// writes the images as <dir>/<index>.jpg, numbered like the data sets
+bool writeSyntheticImages(const std::vector<SyntheticImage> &images, const std::string &dir);
+
+#endif
@@ -0,0 +1,124 @@
+#include "thread_pool.hpp"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads) : remaining(0) {
+        if (threads <= 0) {
+                threads = max(1u, thread::hardware_concurrency());
+        }
+        for (int i = 0; i < threads; i++) {
+                queues.emplace_back(new WorkQueue());
+        }
+        for (int i = 0; i < threads; i++) {
+                workers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+}
+
+ThreadPool::~ThreadPool() {
+        {
+                lock_guard<mutex> lock(stateMutex);
+                stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers) {
+                worker.join();
+        }
+}
+
+void ThreadPool::parallelFor(size_t count, const function<void(size_t)> &loopBody) {
+        if (count == 0) {
+                return;
+        }
+
+        lock_guard<mutex> loopLock(loopMutex);
+        unique_lock<mutex> lock(stateMutex);
+        // a worker that woke for the previous loop after it finished may
+        // still be on its way out of the take loop
+        done.wait(lock, [this] { return active == 0; });
+
+        // contiguous blocks keep neighbouring files on one worker until
+        // stealing kicks in
+        size_t block = (count + queues.size() - 1) / queues.size();
+        for (size_t i = 0; i < count; i++) {
+                auto &queue = *queues[i / block];
+                lock_guard<mutex> queueLock(queue.mutex);
+                queue.items.push_back(i);
+        }
+
+        body = &loopBody;
+        failure = nullptr;
+        remaining = count;
+        generation++;
+        wake.notify_all();
+
+        // the body is only dropped once no worker can still call it
+        done.wait(lock, [this] { return remaining == 0 && active == 0; });
+        body = nullptr;
+
+        if (failure) {
+                rethrow_exception(failure);
+        }
+}
+
+bool ThreadPool::take(size_t self, size_t &item) {
+        {
+                auto &own = *queues[self];
+                lock_guard<mutex> lock(own.mutex);
+                if (!own.items.empty()) {
+                        item = own.items.front();
+                        own.items.pop_front();
+                        return true;
+                }
+        }
+
+        for (size_t i = 1; i < queues.size(); i++) {
+                auto &victim = *queues[(self + i) % queues.size()];
+                lock_guard<mutex> lock(victim.mutex);
+                if (!victim.items.empty()) {
+                        item = victim.items.back();
+                        victim.items.pop_back();
+                        return true;
+                }
+        }
+        return false;
+}
+
+void ThreadPool::workerLoop(size_t self) {
+        unsigned long seen = 0;
+        while (true) {
+                const function<void(size_t)> *loopBody;
+                {
+                        unique_lock<mutex> lock(stateMutex);
+                        wake.wait(lock, [&] { return stopping || generation != seen; });
+                        if (stopping) {
+                                return;
+                        }
+                        seen = generation;
+                        loopBody = body;
+                        active++;
+                }
+
+                size_t item;
+                while (take(self, item)) {
+                        try {
+                                (*loopBody)(item);
+                        } catch (...) {
+                                lock_guard<mutex> lock(stateMutex);
+                                if (!failure) {
+                                        failure = current_exception();
+                                }
+                        }
+
+                        if (--remaining == 0) {
+                                lock_guard<mutex> lock(stateMutex);
+                                done.notify_all();
+                        }
+                }
+
+                {
+                        lock_guard<mutex> lock(stateMutex);
+                        active--;
+                }
+                done.notify_all();
+        }
+}
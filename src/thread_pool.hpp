@@ -0,0 +1,61 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running index loops. Each parallelFor()
+// deals the indices out to per-worker deques; a worker drains its own
+// deque from the front and, once empty, steals from the back of the
+// others, so uneven per-image costs do not leave threads idle.
+class ThreadPool {
+public:
+        // threads <= 0 uses one worker per hardware thread
+        explicit ThreadPool(int threads = 0);
+        ~ThreadPool();
+
+        int size() const { return (int)workers.size(); }
+
+        // calls body(i) for every i in [0, count) and blocks until all are
+        // done; the first exception thrown by body is rethrown here
+        void parallelFor(size_t count, const std::function<void(size_t)> &body);
+
+private:
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        struct WorkQueue {
+                std::mutex mutex;
+                std::deque<size_t> items;
+        };
+
+        void workerLoop(size_t self);
+        bool take(size_t self, size_t &item);
+
+        std::vector<std::thread> workers;
+        std::vector<std::unique_ptr<WorkQueue> > queues;
+
+        std::mutex loopMutex;
+        std::mutex stateMutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        unsigned long generation = 0;
+        // workers inside their take loop; items and body only change
+        // while it is zero
+        int active = 0;
+        bool stopping = false;
+
+        const std::function<void(size_t)> *body = nullptr;
+        std::atomic<size_t> remaining;
+        std::exception_ptr failure;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include "bounded_queue.hpp"
+#include "features.hpp"
+#include "image_loader.hpp"
+#include "metrics.hpp"
+#include "training.hpp"
+
+using namespace std;
+using namespace cv;
+
+// images allowed in flight between two stages, per extraction worker
+const int QUEUE_DEPTH_PER_WORKER = 2;
+
+typedef pair<size_t, Mat> IndexedMat;
+
+// decodes a file read by the loader and gives its buffer back
+static Mat decodeTrainingImage(ImageLoader &loader, LoadedFile &file) {
+        ND_TIMED_SCOPE("decode");
+        Mat image;
+        if (!file.bytes.empty()) {
+                image = imdecode(file.bytes, CV_LOAD_IMAGE_GRAYSCALE);
+        }
+        loader.release(file);
+        return image;
+}
+
+bool extractTrainingModel(const vector<string> &fileNames, DescriptorModelWriter &writer,
+                          const string &backend, int keypointBudget, int workers) {
+        FeatureExtractor serialExtractor;
+        if (!serialExtractor.create(backend)) {
+                return false;
+        }
+        serialExtractor.setKeypointBudget(keypointBudget);
+
+        if (workers <= 1) {
+                ImageLoader loader(fileNames);
+                vector<KeyPoint> keypoints;
+                Mat descriptors;
+                LoadedFile file;
+                while (loader.next(file)) {
+                        Mat image = decodeTrainingImage(loader, file);
+                        serialExtractor.compute(image, keypoints, descriptors);
+                        writer.add(descriptors);
+                }
+                return true;
+        }
+
+        int decoders = max(1, workers / 2);
+        BoundedQueue<IndexedMat> decoded(workers * QUEUE_DEPTH_PER_WORKER);
+        BoundedQueue<IndexedMat> extracted(workers * QUEUE_DEPTH_PER_WORKER);
+
+        // images past the last one written that may be decoded, extracted
+        // or waiting for their turn; a slow image holds the rest back
+        // instead of letting the reorder buffer grow
+        size_t window = workers * QUEUE_DEPTH_PER_WORKER * 2 + decoders;
+        mutex windowMutex;
+        condition_variable windowMoved;
+        size_t written = 0;
+
+        // decode stage, files are handed out in order by the loader, which
+        // reads ahead of every decoder
+        ImageLoader loader(fileNames, LOADER_READ_AHEAD + decoders);
+        atomic<int> decodersLeft(decoders);
+        vector<thread> decodeThreads;
+        for (int i = 0; i < decoders; i++) {
+                decodeThreads.emplace_back([&] {
+                        LoadedFile file;
+                        while (loader.next(file)) {
+                                size_t index = file.index;
+                                {
+                                        unique_lock<mutex> lock(windowMutex);
+                                        windowMoved.wait(lock, [&] { return index < written + window; });
+                                }
+                                decoded.push(IndexedMat(index, decodeTrainingImage(loader, file)));
+                        }
+                        if (--decodersLeft == 0) {
+                                decoded.close();
+                        }
+                });
+        }
+
+        // extraction stage
+        atomic<int> extractorsLeft(workers);
+        vector<thread> extractThreads;
+        for (int i = 0; i < workers; i++) {
+                extractThreads.emplace_back([&] {
+                        FeatureExtractor extractor;
+                        extractor.create(backend);
+                        extractor.setKeypointBudget(keypointBudget);
+                        vector<KeyPoint> keypoints;
+                        IndexedMat item;
+                        while (decoded.pop(item)) {
+                                Mat descriptors;
+                                extractor.compute(item.second, keypoints, descriptors);
+                                extracted.push(IndexedMat(item.first, descriptors));
+                        }
+                        if (--extractorsLeft == 0) {
+                                extracted.close();
+                        }
+                });
+        }
+
+        // serialization stage, a reorder buffer restores file order so the
+        // model matches the serial one byte for byte
+        thread serializeThread([&] {
+                map<size_t, Mat> pending;
+                size_t nextToWrite = 0;
+                IndexedMat item;
+                while (extracted.pop(item)) {
+                        pending[item.first] = item.second;
+                        while (!pending.empty() && pending.begin()->first == nextToWrite) {
+                                writer.add(pending.begin()->second);
+                                pending.erase(pending.begin());
+                                nextToWrite++;
+                        }
+                        {
+                                lock_guard<mutex> lock(windowMutex);
+                                written = nextToWrite;
+                        }
+                        windowMoved.notify_all();
+                }
+        });
+
+        for (auto &t : decodeThreads) {
+                t.join();
+        }
+        for (auto &t : extractThreads) {
+                t.join();
+        }
+        serializeThread.join();
+        return true;
+}
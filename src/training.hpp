@@ -0,0 +1,19 @@
+#ifndef TRAINING_HPP
+#define TRAINING_HPP
+
+#include <string>
+#include <vector>
+
+#include "descriptor_model.hpp"
+
+// Extracts the descriptors of every training image into the model, in
+// file order, with the given feature backend and keypoint budget. With
+// more than one worker, decoding, extraction and serialization run as a
+// pipeline of threads joined by bounded queues; the written model is
+// identical to the one produced serially. False when the backend is not
+// available.
+bool extractTrainingModel(const std::vector<std::string> &fileNames,
+                          DescriptorModelWriter &writer,
+                          const std::string &backend, int keypointBudget, int workers);
+
+#endif